@@ -30,10 +30,17 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/syscall.h>
+#include <kern/sysstat.h>
 #include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <clock.h>
 #include <mips/trapframe.h>
+#include <platform/maxcpus.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
+#include <copyinout.h>
 #include <syscall.h>
 
 
@@ -75,12 +82,458 @@
  * stack, starting at sp+16 to skip over the slots for the
  * registerized values, with copyin().
  */
+
+/*
+ * Each system call has an entry in syscall_table, indexed by call
+ * number, giving its name and a stub that unpacks the arguments from
+ * the trapframe and calls the sys_* function. Numbers with no entry
+ * (the table is sparse, and sized by the highest number in use) get
+ * ENOSYS.
+ *
+ * Like the sys_* functions, stubs return an error code and leave the
+ * value to return in *retval, which is preset to 0. Calls returning
+ * 64-bit values put the low half in tf_v1 themselves.
+ */
+typedef int (*syscall_fn)(struct trapframe *tf, int32_t *retval);
+
+static
+int
+sc_reboot(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_reboot(tf->tf_a0);
+}
+
+static
+int
+sc___time(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys___time((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc_nanosleep(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_nanosleep((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc___sysstat(struct trapframe *tf, int32_t *retval)
+{
+	return sys___sysstat((userptr_t)tf->tf_a0, (int)tf->tf_a1, retval);
+}
+
+#if !OPT_DUMBVM
+static
+int
+sc_sbrk(struct trapframe *tf, int32_t *retval)
+{
+	return sys_sbrk((intptr_t)tf->tf_a0, retval);
+}
+
+static
+int
+sc_mmap(struct trapframe *tf, int32_t *retval)
+{
+	int fd;
+	off_t offset;
+	int err;
+
+	/* fd and offset are on the stack; offset is 8-aligned */
+	err = copyin((const_userptr_t)(tf->tf_sp + 16), &fd, sizeof(fd));
+	if (err) {
+		return err;
+	}
+	err = copyin((const_userptr_t)(tf->tf_sp + 24),
+		     &offset, sizeof(offset));
+	if (err) {
+		return err;
+	}
+	return sys_mmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1,
+			(int)tf->tf_a2, (int)tf->tf_a3, fd, offset, retval);
+}
+
+static
+int
+sc_munmap(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_munmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1);
+}
+#endif
+
+#if OPT_SYSCALLS
+/*
+ * Fetch the 64-bit file position of pread and friends. It does not
+ * fit in the registers after three 32-bit arguments, so it goes on
+ * the stack, in the first 8-aligned slot past the register slots.
+ */
+static
+int
+syscall_getpos(struct trapframe *tf, off_t *pos)
+{
+	return copyin((const_userptr_t)(tf->tf_sp + 16), pos, sizeof(*pos));
+}
+
+static
+int
+sc_open(struct trapframe *tf, int32_t *retval)
+{
+	return sys_open((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+			(mode_t)tf->tf_a2, retval);
+}
+
+static
+int
+sc_close(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_close((int)tf->tf_a0);
+}
+
+static
+int
+sc_pipe(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_pipe((userptr_t)tf->tf_a0);
+}
+
+static
+int
+sc_read(struct trapframe *tf, int32_t *retval)
+{
+	return sys_read((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			(size_t)tf->tf_a2, retval);
+}
+
+static
+int
+sc_write(struct trapframe *tf, int32_t *retval)
+{
+	return sys_write((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (size_t)tf->tf_a2, retval);
+}
+
+static
+int
+sc_readv(struct trapframe *tf, int32_t *retval)
+{
+	return sys_readv((int)tf->tf_a0, (const_userptr_t)tf->tf_a1,
+			 (int)tf->tf_a2, retval);
+}
+
+static
+int
+sc_writev(struct trapframe *tf, int32_t *retval)
+{
+	return sys_writev((int)tf->tf_a0, (const_userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2, retval);
+}
+
+static
+int
+sc_pread(struct trapframe *tf, int32_t *retval)
+{
+	off_t pos;
+	int err;
+
+	err = syscall_getpos(tf, &pos);
+	if (err) {
+		return err;
+	}
+	return sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			 (size_t)tf->tf_a2, pos, retval);
+}
+
+static
+int
+sc_pwrite(struct trapframe *tf, int32_t *retval)
+{
+	off_t pos;
+	int err;
+
+	err = syscall_getpos(tf, &pos);
+	if (err) {
+		return err;
+	}
+	return sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			  (size_t)tf->tf_a2, pos, retval);
+}
+
+static
+int
+sc_preadv(struct trapframe *tf, int32_t *retval)
+{
+	off_t pos;
+	int err;
+
+	err = syscall_getpos(tf, &pos);
+	if (err) {
+		return err;
+	}
+	return sys_preadv((int)tf->tf_a0, (const_userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2, pos, retval);
+}
+
+static
+int
+sc_pwritev(struct trapframe *tf, int32_t *retval)
+{
+	off_t pos;
+	int err;
+
+	err = syscall_getpos(tf, &pos);
+	if (err) {
+		return err;
+	}
+	return sys_pwritev((int)tf->tf_a0, (const_userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2, pos, retval);
+}
+
+static
+int
+sc_lseek(struct trapframe *tf, int32_t *retval)
+{
+	off_t pos, newpos;
+	int whence;
+	int err;
+
+	/* pos is in a2/a3 (a1 is padding), whence on the stack */
+	pos = ((off_t)tf->tf_a2 << 32) | (uint32_t)tf->tf_a3;
+	err = copyin((const_userptr_t)(tf->tf_sp + 16),
+		     &whence, sizeof(whence));
+	if (err) {
+		return err;
+	}
+	err = sys_lseek((int)tf->tf_a0, pos, whence, &newpos);
+	if (err) {
+		return err;
+	}
+	/* 64-bit results go in v0 (high) and v1 (low) */
+	*retval = (int32_t)(newpos >> 32);
+	tf->tf_v1 = (uint32_t)newpos;
+	return 0;
+}
+
+static
+int
+sc_ioctl(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_ioctl((int)tf->tf_a0, (int)tf->tf_a1,
+			 (userptr_t)tf->tf_a2);
+}
+
+static
+int
+sc_execv(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_execv((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+}
+
+static
+int
+sc__exit(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	sys__exit((int)tf->tf_a0);
+	/* does not return */
+}
+
+#if OPT_WAITPID
+static
+int
+sc_fork(struct trapframe *tf, int32_t *retval)
+{
+	return sys_fork(tf, retval);
+}
+
+static
+int
+sc_getpid(struct trapframe *tf, int32_t *retval)
+{
+	(void)tf;
+	return sys_getpid(retval);
+}
+
+static
+int
+sc_waitpid(struct trapframe *tf, int32_t *retval)
+{
+	return sys_waitpid((pid_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2, retval);
+}
+
+static
+int
+sc_setpriority(struct trapframe *tf, int32_t *retval)
+{
+	(void)retval;
+	return sys_setpriority((int)tf->tf_a0, (pid_t)tf->tf_a1,
+			       (int)tf->tf_a2);
+}
+
+static
+int
+sc_getpriority(struct trapframe *tf, int32_t *retval)
+{
+	return sys_getpriority((int)tf->tf_a0, (pid_t)tf->tf_a1, retval);
+}
+#endif
+#endif /* OPT_SYSCALLS */
+
+static const struct {
+	const char *name;
+	syscall_fn fn;
+} syscall_table[] = {
+	[SYS_reboot] =		{ "reboot",	sc_reboot },
+	[SYS___time] =		{ "__time",	sc___time },
+	[SYS_nanosleep] =	{ "nanosleep",	sc_nanosleep },
+	[SYS___sysstat] =	{ "__sysstat",	sc___sysstat },
+#if !OPT_DUMBVM
+	[SYS_sbrk] =		{ "sbrk",	sc_sbrk },
+	[SYS_mmap] =		{ "mmap",	sc_mmap },
+	[SYS_munmap] =		{ "munmap",	sc_munmap },
+#endif
+#if OPT_SYSCALLS
+	[SYS_open] =		{ "open",	sc_open },
+	[SYS_close] =		{ "close",	sc_close },
+	[SYS_pipe] =		{ "pipe",	sc_pipe },
+	[SYS_read] =		{ "read",	sc_read },
+	[SYS_write] =		{ "write",	sc_write },
+	[SYS_readv] =		{ "readv",	sc_readv },
+	[SYS_writev] =		{ "writev",	sc_writev },
+	[SYS_pread] =		{ "pread",	sc_pread },
+	[SYS_pwrite] =		{ "pwrite",	sc_pwrite },
+	[SYS_preadv] =		{ "preadv",	sc_preadv },
+	[SYS_pwritev] =		{ "pwritev",	sc_pwritev },
+	[SYS_lseek] =		{ "lseek",	sc_lseek },
+	[SYS_ioctl] =		{ "ioctl",	sc_ioctl },
+	[SYS_execv] =		{ "execv",	sc_execv },
+	[SYS__exit] =		{ "_exit",	sc__exit },
+#if OPT_WAITPID
+	[SYS_fork] =		{ "fork",	sc_fork },
+	[SYS_getpid] =		{ "getpid",	sc_getpid },
+	[SYS_waitpid] =		{ "waitpid",	sc_waitpid },
+	[SYS_setpriority] =	{ "setpriority", sc_setpriority },
+	[SYS_getpriority] =	{ "getpriority", sc_getpriority },
+#endif
+#endif
+};
+
+#define NSYSCALLS ARRAYCOUNT(syscall_table)
+
+/*
+ * Per-call statistics: how many times each call was made, and the
+ * total time spent in it. A call is counted when dispatched and its
+ * time is added when it returns, so calls that never return (_exit,
+ * a successful execv) are counted but not timed.
+ *
+ * Each cpu keeps its own counts, under a lock that only readers of
+ * the totals ever contend for; the totals are summed when asked for.
+ * A call that moves to another cpu while running has its time added
+ * there, which makes no difference to the sums.
+ */
+struct syscall_cpustats {
+	struct spinlock scs_lock;
+	struct {
+		uint32_t calls;
+		uint64_t nsecs;
+	} scs_calls[NSYSCALLS];
+};
+
+/* Indexed by cpu number; set up by syscall_bootstrap. */
+static struct syscall_cpustats *syscall_stats[MAXCPUS];
+
+static
+uint64_t
+syscall_nsecs(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+/*
+ * Add CALLS calls and NSECS nanoseconds to this cpu's counts for
+ * call CALLNO.
+ */
+static
+void
+syscall_count(unsigned callno, uint32_t calls, uint64_t nsecs)
+{
+	struct syscall_cpustats *scs;
+	int spl;
+
+	/* Stay on this cpu until its lock is held. */
+	spl = splhigh();
+	scs = syscall_stats[curcpu->c_number];
+	if (scs != NULL) {
+		spinlock_acquire(&scs->scs_lock);
+		scs->scs_calls[callno].calls += calls;
+		scs->scs_calls[callno].nsecs += nsecs;
+		spinlock_release(&scs->scs_lock);
+	}
+	splx(spl);
+}
+
+/*
+ * Sum the counts of call CALLNO over all cpus.
+ */
+static
+void
+syscall_getstats(unsigned callno, uint32_t *calls, uint64_t *nsecs)
+{
+	struct syscall_cpustats *scs;
+	unsigned i;
+
+	*calls = 0;
+	*nsecs = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		scs = syscall_stats[i];
+		if (scs == NULL) {
+			continue;
+		}
+		spinlock_acquire(&scs->scs_lock);
+		*calls += scs->scs_calls[callno].calls;
+		*nsecs += scs->scs_calls[callno].nsecs;
+		spinlock_release(&scs->scs_lock);
+	}
+}
+
+/*
+ * Set up the statistics of each cpu. Call once all cpus are up;
+ * calls made before then are not counted.
+ */
+void
+syscall_bootstrap(void)
+{
+	struct syscall_cpustats *scs;
+	unsigned i;
+
+	KASSERT(cpu_count() <= MAXCPUS);
+	for (i=0; i<cpu_count(); i++) {
+		scs = kmalloc(sizeof(*scs));
+		if (scs == NULL) {
+			panic("syscall_bootstrap: Out of memory\n");
+		}
+		bzero(scs, sizeof(*scs));
+		spinlock_init(&scs->scs_lock);
+		syscall_stats[i] = scs;
+	}
+}
+
 void
 syscall(struct trapframe *tf)
 {
-	int callno;
+	unsigned callno;
 	int32_t retval;
 	int err;
+	struct timespec before, after, diff;
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -99,82 +552,19 @@ syscall(struct trapframe *tf)
 
 	retval = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
-		break;
+	if (callno < NSYSCALLS && syscall_table[callno].fn != NULL) {
+		syscall_count(callno, 1, 0);
 
-	    case SYS___time:
-		err = sys___time((userptr_t)tf->tf_a0,
-				 (userptr_t)tf->tf_a1);
-		break;
+		gettime(&before);
+		err = syscall_table[callno].fn(tf, &retval);
+		gettime(&after);
 
-		// -----------------------------------------------
-#if OPT_SYSCALLS
-
-		 case SYS_write:
-		 retval = sys_write(
-			(int)tf->tf_a0,
-			(userptr_t)tf->tf_a1,
-			(int)tf->tf_a2
-		 );
-
-		 if (retval < 0){
-			err = ENOSYS;
-		 }else{
-			err = 0;
-		 }
-		 break;
-
-		// -----------------------------------------------
-
-		case SYS_read:
-		retval = sys_read(
-			(int)tf->tf_a0,
-			(userptr_t)tf->tf_a1,
-			(int)tf->tf_a2
-		);
-
-		if (retval < 0){
-			err = ENOSYS;
-		}else{
-			err = 0;
-		}
-		break;
-		
-		// -----------------------------------------------
-
-		case SYS__exit:
-		err = 0;
-		sys__exit(
-			(int)tf->tf_a0
-		);
-		break;
-
-		// -----------------------------------------------
-
-		case SYS_waitpid:
-		retval = sys_waitpid(
-			(pid_t)tf->tf_a0,
-			(userptr_t)tf->tf_a1,
-			(int)tf->tf_a2
-		);
-		if (retval<0) {
-			err = ENOSYS;
-		}else {
-			err = 0;
-		}
-		
-		break;
-		// -----------------------------------------------
-
-#endif
-	    /* Add stuff here */
-
-	    default:
-		kprintf("Unknown syscall %d\n", callno);
+		timespec_sub(&after, &before, &diff);
+		syscall_count(callno, 0, syscall_nsecs(&diff));
+	}
+	else {
+		kprintf("Unknown syscall %d\n", (int)callno);
 		err = ENOSYS;
-		break;
 	}
 
 
@@ -206,16 +596,84 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 }
 
+/*
+ * Copy out the statistics of up to N implemented calls to the array
+ * of struct sysstat at BUF, in call number order. The number copied
+ * goes in *RETVAL.
+ */
+int
+sys___sysstat(userptr_t buf, int n, int32_t *retval)
+{
+	struct sysstat ss;
+	unsigned i;
+	int count, result;
+
+	if (n < 0) {
+		return EINVAL;
+	}
+
+	count = 0;
+	for (i=0; i<NSYSCALLS && count < n; i++) {
+		if (syscall_table[i].fn == NULL) {
+			continue;
+		}
+		bzero(&ss, sizeof(ss));
+		strcpy(ss.ss_name, syscall_table[i].name);
+		ss.ss_callno = i;
+		syscall_getstats(i, &ss.ss_calls, &ss.ss_nsecs);
+
+		result = copyout(&ss, buf, sizeof(ss));
+		if (result) {
+			return result;
+		}
+		buf = (userptr_t)((vaddr_t)buf + sizeof(ss));
+		count++;
+	}
+
+	*retval = count;
+	return 0;
+}
+
+/*
+ * Print the statistics of every call made so far.
+ */
+void
+syscall_printstats(void)
+{
+	uint32_t calls;
+	uint64_t nsecs;
+	unsigned i;
+
+	kprintf("%-12s %10s %14s %10s\n", "syscall", "calls", "total ns",
+		"avg ns");
+	for (i=0; i<NSYSCALLS; i++) {
+		if (syscall_table[i].fn == NULL) {
+			continue;
+		}
+		syscall_getstats(i, &calls, &nsecs);
+
+		if (calls == 0) {
+			continue;
+		}
+		kprintf("%-12s %10u %14llu %10llu\n", syscall_table[i].name,
+			calls, (unsigned long long)nsecs,
+			(unsigned long long)(nsecs / calls));
+	}
+}
+
 /*
  * Enter user mode for a newly forked process.
  *
- * This function is provided as a reminder. You need to write
- * both it and the code that calls it.
- *
- * Thus, you can trash it and do things another way if you prefer.
+ * TF is the child's copy of the parent's trapframe, already on the
+ * child's kernel stack (see switchframe_init_trapframe). Make fork
+ * return 0 in the child and go.
  */
 void
 enter_forked_process(struct trapframe *tf)
 {
-	(void)tf;
+	tf->tf_v0 = 0;
+	tf->tf_a3 = 0;		/* signal no error */
+	tf->tf_epc += 4;
+
+	mips_usermode(tf);
 }
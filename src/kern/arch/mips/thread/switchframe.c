@@ -31,6 +31,8 @@
 #include <lib.h>
 #include <thread.h>
 #include <threadprivate.h>
+#include <mips/trapframe.h>
+#include <syscall.h>
 
 #include "switchframe.h"
 
@@ -51,20 +53,18 @@ extern void mips_threadstart(/* arguments are in unusual registers */);
  * store the arguments in the s* registers, and use a bit of asm
  * (mips_threadstart) to move them and then jump to thread_startup.
  */
+static
 void
-switchframe_init(struct thread *thread,
-		 void (*entrypoint)(void *data1, unsigned long data2),
-		 void *data1, unsigned long data2)
+switchframe_init_at(struct thread *thread, vaddr_t stacktop,
+		    void (*entrypoint)(void *data1, unsigned long data2),
+		    void *data1, unsigned long data2)
 {
-	vaddr_t stacktop;
 	struct switchframe *sf;
 
         /*
-         * MIPS stacks grow down. t_stack is just a hunk of memory, so
-         * get the other end of it. Then set up a switchframe on the
-         * top of the stack.
+         * MIPS stacks grow down. Set up a switchframe at STACKTOP,
+         * which is normally the top of the stack.
          */
-        stacktop = ((vaddr_t)thread->t_stack) + STACK_SIZE;
         sf = ((struct switchframe *) stacktop) - 1;
 
         /* Zero out the switchframe. */
@@ -96,3 +96,47 @@ switchframe_init(struct thread *thread,
         /* Set ->t_context, and we're done. */
 	thread->t_context = sf;
 }
+
+void
+switchframe_init(struct thread *thread,
+		 void (*entrypoint)(void *data1, unsigned long data2),
+		 void *data1, unsigned long data2)
+{
+	/* t_stack is just a hunk of memory, so get the other end of it. */
+	switchframe_init_at(thread, (vaddr_t)thread->t_stack + STACK_SIZE,
+			    entrypoint, data1, data2);
+}
+
+/*
+ * thread_startup only knows how to call a function of two arguments.
+ */
+static
+void
+forked_threadstart(void *tf, unsigned long unused)
+{
+	(void)unused;
+	enter_forked_process(tf);
+}
+
+/*
+ * Like switchframe_init, but the new thread is the child of fork and
+ * will go to user mode with a copy of TF. mips_usermode requires the
+ * trapframe to be on the thread's own stack, so the copy goes at the
+ * top of the stack, where an exception from user mode would put it,
+ * and the switchframe goes below it.
+ */
+void
+switchframe_init_trapframe(struct thread *thread, const struct trapframe *tf)
+{
+	vaddr_t stacktop;
+	struct trapframe *newtf;
+
+	/* Keep the stack 8-aligned; the trapframe is not a multiple of 8. */
+	stacktop = ((vaddr_t)thread->t_stack) + STACK_SIZE;
+	newtf = (struct trapframe *)
+		((stacktop - sizeof(struct trapframe)) & ~(vaddr_t)7);
+	*newtf = *tf;
+
+	switchframe_init_at(thread, (vaddr_t)newtf,
+			    forked_threadstart, newtf, 0);
+}
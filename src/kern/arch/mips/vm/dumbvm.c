@@ -38,6 +38,7 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <coremap.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -61,51 +62,18 @@
 
 #define DUMBVM_WITH_FREE 1
 
-/*
- * Wrap ram_stealmem in a spinlock.
- */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
-
 //---------------------------------------------------------------------------------------------
 
 #if DUMBVM_WITH_FREE	/* Da qui inizia la nostra implementazione!*/
 
-static struct spinlock freemem_lock = SPINLOCK_INITIALIZER;
-
-static unsigned char *freeRamFrames = NULL;			// bitmap che gestisce stato dei vari frames
-static unsigned long *allocSize = NULL;				// array che tiene traccia dei vari frames consecutivi allocati
-static int nRamFrames = 0;							// variabile che tiene traccia di tutti i frames disponibili
-
-static int allocTableActive = 0;					// flag che indica se la fase di bootstrap è andata a buon fine o meno
-
-static int isTableActive () {						// funzione per verificare stato del bootstrap
-	int active;
-	spinlock_acquire(&freemem_lock);
-	active = allocTableActive;
-	spinlock_release(&freemem_lock);
-	return active;
-}
+/*
+ * I frame liberi sono gestiti dal coremap (vm/coremap.c), un buddy
+ * allocator con una free list per ogni ordine: niente piu' scansione
+ * lineare di tutta la RAM sotto spinlock ad ogni allocazione.
+ */
 
 void vm_bootstrap(void) {
-	nRamFrames = ((int)ram_getsize())/PAGE_SIZE;
-
-	freeRamFrames = kmalloc(sizeof(unsigned char)*nRamFrames);		// allochiamo tutta la ram disponibile!
-	if (freeRamFrames == NULL) return;
-
-	allocSize = kmalloc(sizeof(unsigned long)*nRamFrames);			// anche qui sto allocando tutto (potrebbe creare problemi no?)
-	if (allocSize == NULL) {
-		freeRamFrames = NULL; 
-		return;
-	}
-
-	for (int i=0; i<nRamFrames; i++){				
-		freeRamFrames[i] = (unsigned char)0;		// inizializza tutti i frames a 0 per indicare che sono occupati!
-		allocSize[i] = 0;
-	}
-
-	spinlock_acquire(&freemem_lock);
-	allocTableActive = 1;							// indica che il bootstrap è stato completato correttamente
-	spinlock_release(&freemem_lock);
+	coremap_bootstrap();							// da qui in poi la memoria liberata torna disponibile
 }
 
 /*
@@ -127,96 +95,26 @@ dumbvm_can_sleep(void)
 	}
 }
 
-static paddr_t getfreeppages(unsigned long npages){
-	paddr_t addr;
-	long i, first, found, np = (long)npages;
-	if(!isTableActive()) return 0;
-
-	spinlock_acquire(&freemem_lock);
-
-	for(i=0,first=found=-1;i<nRamFrames;i++){			// for per trovare blocchi liberi
-		if(freeRamFrames[i]){
-			if(i==0 || freeRamFrames[i]==0){
-				first = i;
-			}
-			if(i-first+1> np){
-				found = first;
-				break;
-			}
-		}
-	}
-
-	if(found>=0){
-		for(i=found;i<found+np;i++){					// for per allocare i blocchi liberi trovati
-			freeRamFrames[i] = (unsigned char)0;
-		}
-
-		allocSize[found] = np;
-		addr = (paddr_t)found*PAGE_SIZE;
-	}
-
-	else{
-		addr = 0;
-	}
-
-	spinlock_release(&freemem_lock);
-	return addr;
+static paddr_t getppages(unsigned long npages) {			// prima del bootstrap il coremap usa ram_stealmem
+	return coremap_getkpages(npages);
 }
 
-static paddr_t getppages(unsigned long npages) {			// funzione già esistente! Wrapper di ram_stealmem
-	paddr_t addr;											// usata per allocare un blocco di memoria fisica
-
-	addr = getfreeppages(npages);
-	if(addr == 0) {							// call stealmem se non c'è abbastanza memoria
-		spinlock_acquire(&stealmem_lock);
-		addr = ram_stealmem(npages);
-		spinlock_release(&stealmem_lock);
-	}
-
-	if(addr!=0 && isTableActive()){			// serve a riutilizzare eventuale memoria libera già gestita
-		spinlock_acquire(&freemem_lock);
-		allocSize[addr/PAGE_SIZE] = npages;
-		spinlock_release(&freemem_lock);
-	}
-	return addr;
-};
-
-static int freeppages(paddr_t addr, unsigned long npages){
-	long i, first, np=(long)npages;
-	if(!isTableActive()) return 0;
-
-	first = addr/PAGE_SIZE;								// ricava l'indice della prima pagina da liberare
-	KASSERT(allocSize!=NULL);
-	KASSERT(nRamFrames>first);
-
-	spinlock_acquire(&freemem_lock);
-
-	for(i=first;i<first+np;i++){
-		freeRamFrames[i] = (unsigned char)1;
-	}
-
-	spinlock_release(&freemem_lock);
-
-	return 1;
+static void freeppages(paddr_t addr){
+	if(addr == 0) return;								// segmento mai allocato (as_prepare_load fallita)
+	coremap_freepages(addr);							// la dimensione del blocco la conosce il coremap
 }
 
 void free_kpages(vaddr_t addr){
-	if(isTableActive()){
-		paddr_t paddr = addr - MIPS_KSEG0;				// trasforma indirizzo virtuale in uno fisico
-		long first = paddr/PAGE_SIZE;					// trova l'indice della pagina iniziale
-
-		KASSERT(allocSize!=NULL);
-		KASSERT(nRamFrames>first);
-		freeppages(paddr, allocSize[first]);			// chiama la funzione responsabile della liberazione della memoria
-	}
+	paddr_t paddr = addr - MIPS_KSEG0;					// trasforma indirizzo virtuale in uno fisico
+	freeppages(paddr);
 }
 
 void as_destroy(struct addrspace *as){
 	dumbvm_can_sleep();
 
-	freeppages(as->as_pbase1, as->as_npages1);			// prendi il physical address base del primo segmento e libera npages a partire da quell'indirizzo
-	freeppages(as->as_pbase2, as->as_npages2);
-	freeppages(as->as_stackpbase, DUMBVM_STACKPAGES);
+	freeppages(as->as_pbase1);							// libera i blocchi dei due segmenti e dello stack
+	freeppages(as->as_pbase2);
+	freeppages(as->as_stackpbase);
 	kfree(as);
 }
 
@@ -245,6 +143,12 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+void
+vm_tlbshootdown_all(void)
+{
+	panic("dumbvm tried to do tlb shootdown?!\n");
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
@@ -537,6 +441,11 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 
 #else			/* Qui finisce la nostra implementazione e inizia quella vecchia*/
 
+/*
+ * Wrap ram_stealmem in a spinlock.
+ */
+static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+
 void
 vm_bootstrap(void)
 {
@@ -606,6 +515,12 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+void
+vm_tlbshootdown_all(void)
+{
+	panic("dumbvm tried to do tlb shootdown?!\n");
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
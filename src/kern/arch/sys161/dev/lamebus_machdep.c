@@ -76,6 +76,26 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Stop the on-chip timer, for an idle cpu. There is no way to turn it
+ * off, so push the interrupt as far away as it goes (a few minutes);
+ * if it does come, it restarts the timer as usual.
+ */
+void
+mainbus_hardclock_stop(void)
+{
+	mips_timer_set(0xffffffff);
+}
+
+/*
+ * Restart the on-chip timer, when a cpu stops idling.
+ */
+void
+mainbus_hardclock_start(void)
+{
+	mips_timer_set(CPU_FREQUENCY / HZ);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
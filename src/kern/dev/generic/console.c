@@ -39,6 +39,17 @@
  * supported, although such support could be added without undue
  * difficulty.
  *
+ * Output is buffered: characters are queued in a ring buffer and
+ * the writer carries on, while the device's write-done interrupt
+ * sends the next one. A writer only waits if the buffer is full.
+ *
+ * Input is raw by default: characters are passed on as typed, with no
+ * echo, which is what programs reading single keystrokes expect. A
+ * program can ask for canonical (line) mode with IOCTL_CON_SETCANON;
+ * then the read-ready interrupt does the line editing and echo, and a
+ * reader is woken once a whole line is ready. The kernel's own getch
+ * always sees raw characters.
+ *
  * Note that nothing happens until we have a device to write to. A
  * buffer of size DELAYBUFSIZE is used to hold output that is
  * generated before this point. This means that (1) using kprintf for
@@ -50,11 +61,14 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <kern/ioctl.h>
 #include <uio.h>
+#include <copyinout.h>
 #include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -109,15 +123,110 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+/*
+ * Output ring buffer. The buffer is empty when head == tail, so one
+ * slot is always left unused.
+ */
+
+static
+unsigned
+con_outcount(struct con_softc *cs)
+{
+	return (cs->cs_outbuf_head + CONSOLE_OUTPUT_BUFFER_SIZE -
+		cs->cs_outbuf_tail) % CONSOLE_OUTPUT_BUFFER_SIZE;
+}
+
+static
+int
+con_dequeue(struct con_softc *cs)
+{
+	int ch;
+
+	KASSERT(cs->cs_outbuf_head != cs->cs_outbuf_tail);
+	ch = cs->cs_outbuf[cs->cs_outbuf_tail];
+	cs->cs_outbuf_tail =
+		(cs->cs_outbuf_tail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	return ch;
+}
+
+/*
+ * If the device is idle, hand it the next queued character. Its
+ * write-done interrupt will come back for the rest.
+ */
+static
+void
+con_kick(struct con_softc *cs)
+{
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (!cs->cs_outbusy && cs->cs_outbuf_head != cs->cs_outbuf_tail) {
+		cs->cs_outbusy = true;
+		cs->cs_send(cs->cs_devdata, con_dequeue(cs));
+	}
+}
+
+/*
+ * Queue a character, waiting for room if the buffer is full.
+ */
+static
+void
+con_enqueue(struct con_softc *cs, int ch)
+{
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	while (con_outcount(cs) == CONSOLE_OUTPUT_BUFFER_SIZE - 1) {
+		con_kick(cs);
+		cs->cs_outwaiting = true;
+		wchan_sleep(cs->cs_outwchan, &cs->cs_outlock);
+	}
+	cs->cs_outbuf[cs->cs_outbuf_head] = ch;
+	cs->cs_outbuf_head =
+		(cs->cs_outbuf_head + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+}
+
+/*
+ * Queue LEN characters from BUF, turning newlines into CR-LF.
+ */
+static
+void
+con_write(struct con_softc *cs, const char *buf, size_t len)
+{
+	size_t i;
+
+	spinlock_acquire(&cs->cs_outlock);
+	for (i=0; i<len; i++) {
+		if (buf[i] == '\n') {
+			con_enqueue(cs, '\r');
+		}
+		con_enqueue(cs, buf[i]);
+	}
+	con_kick(cs);
+	spinlock_release(&cs->cs_outlock);
+}
+
+//////////////////////////////////////////////////
+
 /*
  * Print a character, using polling instead of interrupts to wait for
- * I/O completion.
+ * I/O completion. Whatever is still queued goes first, so output
+ * comes out in order. (Unless we are here because something went
+ * wrong while holding the buffer lock; then just print.)
  */
 static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	if (spinlock_do_i_hold(&cs->cs_outlock)) {
+		cs->cs_sendpolled(cs->cs_devdata, ch);
+		return;
+	}
+
+	spinlock_acquire(&cs->cs_outlock);
+	while (cs->cs_outbuf_head != cs->cs_outbuf_tail) {
+		cs->cs_sendpolled(cs->cs_devdata, con_dequeue(cs));
+	}
 	cs->cs_sendpolled(cs->cs_devdata, ch);
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -129,62 +238,231 @@ static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	spinlock_acquire(&cs->cs_outlock);
+	con_enqueue(cs, ch);
+	con_kick(cs);
+	spinlock_release(&cs->cs_outlock);
 }
 
+//////////////////////////////////////////////////
+
 /*
- * Read a character, using interrupts to wait for I/O completion.
+ * Input. cs_gotchars is a ring buffer like the output one: empty when
+ * head == tail, full with one slot left unused.
  */
+
+static
+unsigned
+con_incount(struct con_softc *cs)
+{
+	return (cs->cs_gotchars_head + CONSOLE_INPUT_BUFFER_SIZE -
+		cs->cs_gotchars_tail) % CONSOLE_INPUT_BUFFER_SIZE;
+}
+
 static
 int
-getch_intr(struct con_softc *cs)
+con_ingetc(struct con_softc *cs)
 {
-	unsigned char ret;
+	int ch;
 
-	P(cs->cs_rsem);
-	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
+	KASSERT(cs->cs_gotchars_head != cs->cs_gotchars_tail);
+	ch = cs->cs_gotchars[cs->cs_gotchars_tail];
 	cs->cs_gotchars_tail =
 		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+	return ch;
+}
+
+static
+void
+con_inputc(struct con_softc *cs, int ch)
+{
+	KASSERT(con_incount(cs) < CONSOLE_INPUT_BUFFER_SIZE - 1);
+	cs->cs_gotchars[cs->cs_gotchars_head] = ch;
+	cs->cs_gotchars_head =
+		(cs->cs_gotchars_head + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+}
+
+/*
+ * Echo a character typed in canonical mode. This happens in the
+ * interrupt handler, so it cannot wait for room in the output buffer;
+ * if there is none, the echo is lost.
+ */
+static
+void
+con_echo(struct con_softc *cs, int ch)
+{
+	spinlock_acquire(&cs->cs_outlock);
+	if (ch == '\n' &&
+	    con_outcount(cs) < CONSOLE_OUTPUT_BUFFER_SIZE - 1) {
+		cs->cs_outbuf[cs->cs_outbuf_head] = '\r';
+		cs->cs_outbuf_head =
+			(cs->cs_outbuf_head + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	}
+	if (con_outcount(cs) < CONSOLE_OUTPUT_BUFFER_SIZE - 1) {
+		cs->cs_outbuf[cs->cs_outbuf_head] = ch;
+		cs->cs_outbuf_head =
+			(cs->cs_outbuf_head + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	}
+	con_kick(cs);
+	spinlock_release(&cs->cs_outlock);
+}
+
+/*
+ * Erase the last character of the line being edited.
+ */
+static
+void
+con_erase(struct con_softc *cs)
+{
+	if (cs->cs_linelen > 0) {
+		cs->cs_linelen--;
+		con_echo(cs, '\b');
+		con_echo(cs, ' ');
+		con_echo(cs, '\b');
+	}
+}
+
+/*
+ * Hand the line being edited over to readers. If the input buffer
+ * cannot take all of it, the line is dropped.
+ */
+static
+void
+con_endline(struct con_softc *cs)
+{
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_inlock));
+
+	if (con_incount(cs) + cs->cs_linelen < CONSOLE_INPUT_BUFFER_SIZE) {
+		for (i=0; i<cs->cs_linelen; i++) {
+			con_inputc(cs, cs->cs_line[i]);
+		}
+	}
+	else {
+		con_echo(cs, '\a');
+	}
+	cs->cs_linelen = 0;
+	wchan_wakeall(cs->cs_inwchan, &cs->cs_inlock);
+}
+
+/*
+ * Switch between raw and canonical input. A half-typed line is passed
+ * on as it is when going to raw mode.
+ */
+static
+void
+con_setmode(struct con_softc *cs, bool canon)
+{
+	KASSERT(spinlock_do_i_hold(&cs->cs_inlock));
+
+	if (cs->cs_canon && !canon && cs->cs_linelen > 0) {
+		con_endline(cs);
+	}
+	cs->cs_canon = canon;
+}
+
+/*
+ * Read a character in raw mode, using interrupts to wait for I/O
+ * completion.
+ */
+static
+int
+getch_intr(struct con_softc *cs)
+{
+	int ret;
+
+	spinlock_acquire(&cs->cs_inlock);
+	con_setmode(cs, false);
+	while (cs->cs_gotchars_head == cs->cs_gotchars_tail) {
+		wchan_sleep(cs->cs_inwchan, &cs->cs_inlock);
+	}
+	ret = con_ingetc(cs);
+	spinlock_release(&cs->cs_inlock);
 	return ret;
 }
 
 /*
  * Called from underlying device when a read-ready interrupt occurs.
  *
- * Note: if gotchars_head == gotchars_tail, the buffer is empty. Thus
- * if gotchars_head+1 == gotchars_tail, the buffer is full. A slightly
- * tidier way to implement this check (that avoids wasting a slot,
- * too) would be with a second semaphore used with a nonblocking P,
- * but we don't have that in OS/161.
+ * In raw mode the character is queued for getch, or dropped if there
+ * is no room. In canonical mode it is added to the line being edited
+ * and echoed; erase (backspace or delete) and kill (^U) edit the line,
+ * and newline or ^D completes it. ^D on an empty line makes the next
+ * read return 0 (end of file).
  */
 void
 con_input(void *vcs, int ch)
 {
 	struct con_softc *cs = vcs;
-	unsigned nexthead;
 
-	nexthead = (cs->cs_gotchars_head + 1) % CONSOLE_INPUT_BUFFER_SIZE;
-	if (nexthead == cs->cs_gotchars_tail) {
-		/* overflow; drop character */
+	spinlock_acquire(&cs->cs_inlock);
+
+	if (!cs->cs_canon) {
+		if (con_incount(cs) < CONSOLE_INPUT_BUFFER_SIZE - 1) {
+			con_inputc(cs, ch);
+			wchan_wakeall(cs->cs_inwchan, &cs->cs_inlock);
+		}
+		spinlock_release(&cs->cs_inlock);
 		return;
 	}
 
-	cs->cs_gotchars[cs->cs_gotchars_head] = ch;
-	cs->cs_gotchars_head = nexthead;
+	switch (ch) {
+	    case '\b':
+	    case 127:
+		con_erase(cs);
+		break;
+	    case 21:	/* ^U */
+		while (cs->cs_linelen > 0) {
+			con_erase(cs);
+		}
+		break;
+	    case 4:	/* ^D */
+		if (cs->cs_linelen == 0) {
+			cs->cs_ineof = true;
+		}
+		con_endline(cs);
+		break;
+	    case '\r':
+	    case '\n':
+		cs->cs_line[cs->cs_linelen++] = '\n';
+		con_echo(cs, '\n');
+		con_endline(cs);
+		break;
+	    default:
+		/* Always leave room for the newline. */
+		if (cs->cs_linelen < CONSOLE_LINE_SIZE - 1) {
+			cs->cs_line[cs->cs_linelen++] = ch;
+			con_echo(cs, ch);
+		}
+		else {
+			con_echo(cs, '\a');
+		}
+		break;
+	}
 
-	V(cs->cs_rsem);
+	spinlock_release(&cs->cs_inlock);
 }
 
 /*
- * Called from underlying device when a write-done interrupt occurs.
+ * Called from underlying device when a write-done interrupt occurs:
+ * send the next character, if any. Writers waiting for room are
+ * woken once half the buffer is free, not for every character.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_outlock);
+	cs->cs_outbusy = false;
+	con_kick(cs);
+	if (cs->cs_outwaiting &&
+	    con_outcount(cs) < CONSOLE_OUTPUT_BUFFER_SIZE / 2) {
+		cs->cs_outwaiting = false;
+		wchan_wakeall(cs->cs_outwchan, &cs->cs_outlock);
+	}
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -240,16 +518,113 @@ con_eachopen(struct device *dev, int openflags)
 	return 0;
 }
 
+/*
+ * Read from the console in raw mode: pass characters on as they come,
+ * until the buffer is full or a newline arrives.
+ */
+static
+int
+con_readraw(struct con_softc *cs, struct uio *uio)
+{
+	char ch;
+	int result;
+
+	while (uio->uio_resid > 0) {
+		spinlock_acquire(&cs->cs_inlock);
+		while (cs->cs_gotchars_head == cs->cs_gotchars_tail) {
+			wchan_sleep(cs->cs_inwchan, &cs->cs_inlock);
+		}
+		ch = con_ingetc(cs);
+		spinlock_release(&cs->cs_inlock);
+
+		if (ch == '\r') {
+			ch = '\n';
+		}
+		result = uiomove(&ch, 1, uio);
+		if (result) {
+			return result;
+		}
+		if (ch == '\n') {
+			break;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Read from the console in canonical mode: wait for a line, then copy
+ * out as much of it as fits. Whatever does not fit is left for the
+ * next read.
+ */
+static
+int
+con_readline(struct con_softc *cs, struct uio *uio)
+{
+	char buf[CONSOLE_LINE_SIZE];
+	size_t len;
+	bool eol;
+	int result;
+
+	spinlock_acquire(&cs->cs_inlock);
+	while (cs->cs_gotchars_head == cs->cs_gotchars_tail &&
+	       !cs->cs_ineof) {
+		wchan_sleep(cs->cs_inwchan, &cs->cs_inlock);
+	}
+	if (cs->cs_gotchars_head == cs->cs_gotchars_tail) {
+		/* ^D on an empty line */
+		cs->cs_ineof = false;
+		spinlock_release(&cs->cs_inlock);
+		return 0;
+	}
+
+	eol = false;
+	while (uio->uio_resid > 0 && !eol &&
+	       cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+		len = 0;
+		while (len < sizeof(buf) && len < uio->uio_resid && !eol &&
+		       cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+			buf[len] = con_ingetc(cs);
+			/* could have been typed in raw mode */
+			if (buf[len] == '\r') {
+				buf[len] = '\n';
+			}
+			eol = buf[len] == '\n';
+			len++;
+		}
+		spinlock_release(&cs->cs_inlock);
+
+		result = uiomove(buf, len, uio);
+		if (result) {
+			return result;
+		}
+		spinlock_acquire(&cs->cs_inlock);
+	}
+	spinlock_release(&cs->cs_inlock);
+	return 0;
+}
+
+static
+int
+con_read(struct con_softc *cs, struct uio *uio)
+{
+	bool canon;
+
+	spinlock_acquire(&cs->cs_inlock);
+	canon = cs->cs_canon;
+	spinlock_release(&cs->cs_inlock);
+
+	return canon ? con_readline(cs, uio) : con_readraw(cs, uio);
+}
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
 {
 	int result;
-	char ch;
+	char buf[128];
+	size_t len;
 	struct lock *lk;
 
-	(void)dev;  // unused
-
 	if (uio->uio_rw==UIO_READ) {
 		lk = con_userlock_read;
 	}
@@ -260,32 +635,22 @@ con_io(struct device *dev, struct uio *uio)
 	KASSERT(lk != NULL);
 	lock_acquire(lk);
 
+	if (uio->uio_rw==UIO_READ) {
+		result = con_read(dev->d_data, uio);
+		lock_release(lk);
+		return result;
+	}
+
 	while (uio->uio_resid > 0) {
-		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
-			}
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				break;
-			}
-		}
-		else {
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
+		/* Queue a block at a time; don't wait for it. */
+		len = uio->uio_resid < sizeof(buf) ?
+			uio->uio_resid : sizeof(buf);
+		result = uiomove(buf, len, uio);
+		if (result) {
+			lock_release(lk);
+			return result;
 		}
+		con_write(dev->d_data, buf, len);
 	}
 	lock_release(lk);
 	return 0;
@@ -295,10 +660,20 @@ static
 int
 con_ioctl(struct device *dev, int op, userptr_t data)
 {
-	/* No ioctls. */
-	(void)dev;
-	(void)op;
-	(void)data;
+	struct con_softc *cs = dev->d_data;
+	int canon, result;
+
+	switch (op) {
+	    case IOCTL_CON_SETCANON:
+		result = copyin(data, &canon, sizeof(canon));
+		if (result) {
+			return result;
+		}
+		spinlock_acquire(&cs->cs_inlock);
+		con_setmode(cs, canon != 0);
+		spinlock_release(&cs->cs_inlock);
+		return 0;
+	}
 	return EINVAL;
 }
 
@@ -343,7 +718,7 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct wchan *rwchan, *wchan;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -359,33 +734,43 @@ config_con(struct con_softc *cs, int unit)
 	}
 	KASSERT(the_console==NULL);
 
-	rsem = sem_create("console read", 0);
-	if (rsem == NULL) {
+	rwchan = wchan_create("console read");
+	if (rwchan == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
-		sem_destroy(rsem);
+	wchan = wchan_create("console write");
+	if (wchan == NULL) {
+		wchan_destroy(rwchan);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(rwchan);
+		wchan_destroy(wchan);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(rwchan);
+		wchan_destroy(wchan);
 		return ENOMEM;
 	}
 
-	cs->cs_rsem = rsem;
-	cs->cs_wsem = wsem;
+	spinlock_init(&cs->cs_inlock);
+	cs->cs_inwchan = rwchan;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	cs->cs_linelen = 0;
+	cs->cs_canon = false;
+	cs->cs_ineof = false;
+
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outwchan = wchan;
+	cs->cs_outbuf_head = 0;
+	cs->cs_outbuf_tail = 0;
+	cs->cs_outbusy = false;
+	cs->cs_outwaiting = false;
 
 	the_console = cs;
 	con_userlock_read = rlk;
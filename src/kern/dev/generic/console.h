@@ -35,9 +35,26 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output goes through a ring buffer: writers queue characters and
+ * return, and the write-done interrupt (con_start) feeds the next
+ * queued character to the device. cs_outlock protects the buffer.
+ *
+ * Input is handled by the read-ready interrupt (con_input). In raw
+ * mode, the default and the one used by the kernel's own getch, each
+ * character goes straight into cs_gotchars. In canonical mode, which
+ * a program asks for with IOCTL_CON_SETCANON, the interrupt assembles
+ * a line in cs_line, echoing and handling erase, and moves it to
+ * cs_gotchars only once it is complete, so a reader is woken once per
+ * line rather than once per keystroke. cs_inlock
+ * protects all of the input state; it is taken before cs_outlock.
  */
 
-#define CONSOLE_INPUT_BUFFER_SIZE 32
+#include <spinlock.h>
+
+#define CONSOLE_INPUT_BUFFER_SIZE 256
+#define CONSOLE_LINE_SIZE 128
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -46,11 +63,23 @@ struct con_softc {
 	void (*cs_sendpolled)(void *devdata, int ch);
 
 	/* initialized by config routine */
-	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
+	struct spinlock cs_inlock;
+	struct wchan *cs_inwchan;	/* readers waiting for input */
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+	unsigned char cs_line[CONSOLE_LINE_SIZE];
+	unsigned cs_linelen;		/* chars in the line being edited */
+	bool cs_canon;			/* canonical (line) mode */
+	bool cs_ineof;			/* ^D typed on an empty line */
+
+	struct spinlock cs_outlock;
+	struct wchan *cs_outwchan;	/* writers waiting for room */
+	unsigned char cs_outbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outbuf_head;	/* next slot to put a char in */
+	unsigned cs_outbuf_tail;	/* next slot to take a char out */
+	bool cs_outbusy;		/* device is sending a char */
+	bool cs_outwaiting;		/* somebody is on cs_outwchan */
 };
 
 /*
@@ -845,13 +845,16 @@ emufs_namefile(struct vnode *v, struct uio *uio)
 
 /*
  * VOP_MMAP
+ *
+ * Files can be mapped; the VM page cache reads and writes them with
+ * emufs_read and emufs_write.
  */
 static
 int
 emufs_mmap(struct vnode *v)
 {
 	(void)v;
-	return ENOSYS;
+	return 0;
 }
 
 //////////////////////////////
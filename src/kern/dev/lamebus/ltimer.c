@@ -49,7 +49,7 @@
 /* Granularity of countdown timer (usec) */
 #define LT_GRANULARITY   1000000
 
-static bool havetimerclock;
+static struct ltimer_softc *timerclock_lt;
 
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
@@ -87,14 +87,16 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 	 * We do, however, use ltimer for the timer clock, since the
 	 * on-chip timer can't do that.
 	 */
-	if (!havetimerclock) {
-		havetimerclock = true;
+	if (timerclock_lt == NULL) {
+		timerclock_lt = lt;
 		lt->lt_timerclock = 1;
 
-		/* Wire it to go off once every second. */
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
-				   LT_GRANULARITY);
+		/*
+		 * Don't restart on expiry: the countdown is set each
+		 * time for the next callout (see timerclock_set), and
+		 * left off when there is none.
+		 */
+		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 0);
 	}
 
 	return 0;
@@ -127,6 +129,24 @@ ltimer_irq(void *vlt)
 	}
 }
 
+/*
+ * Have the timer clock go off once, USECS microseconds from now.
+ * Writing the count register starts the countdown over.
+ */
+void
+timerclock_set(uint32_t usecs)
+{
+	if (timerclock_lt == NULL) {
+		/* Not attached yet; nothing sleeps on time this early. */
+		return;
+	}
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	bus_write_register(timerclock_lt->lt_bus, timerclock_lt->lt_buspos,
+			   LT_REG_COUNT, usecs);
+}
+
 /*
  * The timer device will beep if you write to the beep register. It
  * doesn't matter what value you write. This function is called if
@@ -232,14 +232,15 @@ sfs_fsync(struct vnode *v)
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Regular files can be mapped; the VM page cache
+ * moves the pages with sfs_read and sfs_write.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v)
 {
 	(void)v;
-	return ENOSYS;
+	return 0;
 }
 
 /*
@@ -36,9 +36,68 @@
 
 
 #include <vm.h>
+#include <spinlock.h>
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct pagetable;
+
+#if !OPT_DUMBVM
+/*
+ * A region is a page-aligned range of the address space with uniform
+ * permissions. Pages in a region are not backed by memory until they
+ * are first touched; vm_fault then hands out a zero-filled frame.
+ *
+ * A region loaded from an executable also records where its contents
+ * are in the file: VR_FILESIZE bytes at offset VR_FILEOFF belong at
+ * address VR_FILEBASE (which need not be page aligned). These are
+ * read in page by page as the pages are touched; the rest of the
+ * region (the bss) stays zero-filled.
+ *
+ * Regions made by mmap are marked VR_MAPPED. If one maps a file,
+ * VR_VNODE and VR_FILEOFF say which page of it backs VR_BASE, and its
+ * pages come from the page cache (vmcache.h) instead of being read
+ * into private frames. VR_SHARED regions keep sharing their frames,
+ * writeable, across fork, rather than going copy-on-write. Regions
+ * mapping files are also on a list kept by the page cache, linked
+ * through VR_MAPNEXT, so that it can find the mappings of a page it
+ * wants to evict.
+ */
+struct vmregion {
+        vaddr_t vr_base;                /* first address, page aligned */
+        size_t vr_npages;               /* length in pages */
+        int vr_perm;                    /* VR_R/W/X below */
+        int vr_flags;                   /* VR_MAPPED/SHARED below */
+        struct vnode *vr_vnode;         /* file backing, or NULL */
+        off_t vr_fileoff;               /* where the data starts in it */
+        vaddr_t vr_filebase;            /* where the data goes */
+        size_t vr_filesize;             /* how much of it there is */
+        struct addrspace *vr_as;        /* space the region is in */
+        struct vmregion *vr_next;       /* next region in the space */
+        struct vmregion *vr_mapnext;    /* next region mapping a file */
+};
+
+#define VR_R    0x4     /* readable */
+#define VR_W    0x2     /* writeable */
+#define VR_X    0x1     /* executable */
+
+#define VR_MAPPED       0x1     /* made by mmap; may be unmapped */
+#define VR_SHARED       0x2     /* MAP_SHARED */
+
+/*
+ * The user stack starts out as one page at the top of user space and
+ * grows down, a page at a time, as faults touch the pages below it,
+ * up to VM_STACKMAXPAGES. Below that, VM_STACKGUARDPAGES of address
+ * space are kept empty, so running off the end of the stack faults
+ * instead of landing in the heap or a mapping. Nothing else may be
+ * placed above VM_STACKFLOOR.
+ */
+/* (the maximum must be > 64K so argument blocks of size ARG_MAX fit) */
+#define VM_STACKMAXPAGES        512
+#define VM_STACKGUARDPAGES      16
+#define VM_STACKFLOOR \
+        (USERSTACK - (VM_STACKMAXPAGES + VM_STACKGUARDPAGES) * PAGE_SIZE)
+#endif
 
 
 /*
@@ -58,7 +117,14 @@ struct addrspace {
         size_t as_npages2;
         paddr_t as_stackpbase;
 #else
-        /* Put stuff here for your VM system */
+        struct vmregion *as_regions;    /* defined regions */
+        struct vmregion *as_lastregion; /* last found, checked first */
+        struct pagetable *as_pt;        /* page table */
+        struct spinlock as_lock;        /* protects page table entries */
+        bool as_loading;                /* between prepare/complete_load */
+        struct vmregion *as_heap;       /* heap region, grown by sbrk */
+        struct vmregion *as_stack;      /* stack region, grown by faults */
+        vaddr_t as_heapend;             /* the break */
 #endif
 };
 
@@ -87,7 +153,8 @@ struct addrspace {
  *                the way this works if implementing user-level threads.
  *
  *    as_define_region - set up a region of memory within the address
- *                space.
+ *                space. Fails with ENOEXEC if it overlaps a region
+ *                already defined.
  *
  *    as_prepare_load - this is called before actually loading from an
  *                executable into the address space.
@@ -118,6 +185,53 @@ int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
+#if !OPT_DUMBVM
+/*
+ *    as_findregion - return the region containing VADDR, or NULL if
+ *                the address is not part of the address space.
+ *
+ *    as_lockpage - take the page lock (see coremap.h) on the frame the
+ *                page table entry PTE of AS points to, and return its
+ *                address. Returns 0 if the page is not resident (or
+ *                no longer mapped at all).
+ *
+ *    as_define_filedata - record that the region last defined with
+ *                as_define_region is to be filled with FILESIZE bytes
+ *                from V at OFFSET, placed at VADDR. Nothing is read
+ *                until the pages are touched.
+ *
+ *    as_fillpage - read whatever file data belongs in the page at
+ *                VADDR into the kernel buffer KBUF, which the caller
+ *                has zeroed. May sleep.
+ *
+ *    as_growstack - if VADDR is in the part of the stack reservation
+ *                not yet used, extend the stack region down to cover
+ *                it and return the region. Otherwise return NULL.
+ *
+ *    as_sbrk   - move the break by AMOUNT bytes and hand back the old
+ *                one in OLDBREAK. Pages given up are freed at once.
+ *
+ *    as_mmap   - map LEN bytes of V starting at OFFSET, or anonymous
+ *                memory if V is NULL, with protection PROT and flags
+ *                FLAGS (see <kern/mman.h>). ADDR is a hint, or with
+ *                MAP_FIXED the required address. Hands back the
+ *                address chosen in RET.
+ *
+ *    as_munmap - remove the mappings in the LEN bytes at ADDR. Only
+ *                regions made by as_mmap may be unmapped.
+ */
+struct vmregion  *as_findregion(struct addrspace *as, vaddr_t vaddr);
+paddr_t as_lockpage(struct addrspace *as, uint32_t *pte);
+int as_define_filedata(struct addrspace *as, vaddr_t vaddr, size_t filesize,
+                       struct vnode *v, off_t offset);
+int as_fillpage(struct addrspace *as, vaddr_t vaddr, void *kbuf);
+struct vmregion  *as_growstack(struct addrspace *as, vaddr_t vaddr);
+int as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak);
+int as_mmap(struct addrspace *as, vaddr_t addr, size_t len, int prot,
+            int flags, struct vnode *v, off_t offset, vaddr_t *ret);
+int as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+#endif
+
 
 /*
  * Functions in loadelf.c
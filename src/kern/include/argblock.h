@@ -0,0 +1,50 @@
+#ifndef _ARGBLOCK_H_
+#define _ARGBLOCK_H_
+
+/*
+ * Argument blocks for execv and runprogram.
+ *
+ * The arguments of the new program are gathered into one kernel
+ * buffer laid out exactly as they will be on the new user stack: an
+ * array of argc+1 pointers followed by the packed strings. Until the
+ * block is placed the pointers hold offsets into the buffer; placing
+ * it fixes them up and copies the whole thing out at once.
+ *
+ * The buffer starts at a page and doubles as needed; the pointers and
+ * strings together may take at most ARG_MAX bytes, or E2BIG.
+ */
+
+struct argblock {
+	char *ab_buf;			/* pointers, then strings */
+	size_t ab_size;			/* size of ab_buf */
+	size_t ab_len;			/* bytes in use */
+	int ab_argc;			/* number of arguments */
+};
+
+/*
+ * Functions in argblock.c:
+ *
+ *    argblock_copyin  - fill AB from the user argv array UARGV, which
+ *                       ends with a null pointer.
+ *
+ *    argblock_kinit   - fill AB from the ARGC kernel strings in ARGS.
+ *
+ *    argblock_arg     - return argument I of AB, before it is placed.
+ *
+ *    argblock_copyout - place AB on the user stack just below
+ *                       *STACKPTR in the current address space. Updates
+ *                       *STACKPTR and returns the user address of the
+ *                       argv array in UARGV.
+ *
+ *    argblock_cleanup - free AB's buffer.
+ */
+
+int argblock_copyin(struct argblock *ab, userptr_t uargv);
+int argblock_kinit(struct argblock *ab, int argc, char **args);
+const char *argblock_arg(struct argblock *ab, int i);
+int argblock_copyout(struct argblock *ab, vaddr_t *stackptr,
+		     userptr_t *uargv);
+void argblock_cleanup(struct argblock *ab);
+
+
+#endif /* _ARGBLOCK_H_ */
@@ -0,0 +1,56 @@
+#ifndef _CALLOUT_H_
+#define _CALLOUT_H_
+
+/*
+ * Callouts: functions to be called from the timer interrupt at a set
+ * time, with millisecond resolution.
+ *
+ * Time is counted in callout ticks, milliseconds of the time of day.
+ * Pending callouts hang off a timer wheel of CALLOUT_WHEELSIZE slots;
+ * one due at tick T goes in slot T % CALLOUT_WHEELSIZE, and one due
+ * more than a turn of the wheel ahead just stays in its slot until
+ * its turn comes. The timer device is not ticking; it is programmed
+ * (with timerclock_set) for the earliest pending callout only, so no
+ * timer interrupts happen while nothing is due.
+ *
+ * Callout functions run in interrupt context, with no locks held,
+ * and must not sleep. A struct callout belongs to its owner, who
+ * must keep it around until it has run or been stopped.
+ */
+
+/* Number of slots in the wheel; must be a power of 2. */
+#define CALLOUT_WHEELSIZE 256
+
+struct callout {
+	void (*co_func)(void *);	/* function to call */
+	void *co_arg;			/* ...and its argument */
+	uint64_t co_when;		/* tick it is due at */
+	bool co_pending;		/* on the wheel */
+	struct callout *co_next;	/* slot chain */
+	struct callout **co_prevp;	/* link pointing at us */
+};
+
+/*
+ * Functions in callout.c:
+ *
+ *    callout_init      - prepare CO to call FUNC(ARG).
+ *
+ *    callout_schedule  - arrange for CO to run NSECS from now, rounded
+ *                        up to a whole tick. A pending callout is
+ *                        moved to the new time.
+ *
+ *    callout_stop      - cancel CO. Returns true if it was pending;
+ *                        if not, it may have run or be running.
+ *
+ *    callout_run       - call the functions of the callouts now due,
+ *                        and program the timer for the next one.
+ *                        Called from timerclock().
+ */
+
+void callout_init(struct callout *co, void (*func)(void *), void *arg);
+void callout_schedule(struct callout *co, uint64_t nsecs);
+bool callout_stop(struct callout *co);
+void callout_run(void);
+
+
+#endif /* _CALLOUT_H_ */
@@ -49,15 +49,20 @@ void hardclock_bootstrap(void);
 void hardclock(void);
 
 /*
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU when the timer set with
+ * timerclock_set() goes off, USECS microseconds after the call. It
+ * runs the callouts that are due (see callout.h), which is what sets
+ * the timer, so it only goes off when something is due.
  */
 void timerclock(void);
+void timerclock_set(uint32_t usecs);
 
 /*
- * gettime() may be used to fetch the current time of day.
+ * gettime() may be used to fetch the current time of day, once
+ * gettime_ready() says autoconfiguration has found a clock.
  */
 void gettime(struct timespec *ret);
+bool gettime_ready(void);
 
 /*
  * arithmetic on times
@@ -76,8 +81,12 @@ void timespec_sub(const struct timespec *t1,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ *
+ * thread_sleep_ns() does the same for NSECS nanoseconds, rounded up
+ * to the next millisecond.
  */
 void clocksleep(int seconds);
+void thread_sleep_ns(uint64_t nsecs);
 
 
 #endif /* _CLOCK_H_ */
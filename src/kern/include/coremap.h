@@ -0,0 +1,165 @@
+#ifndef _COREMAP_H_
+#define _COREMAP_H_
+
+/*
+ * Physical memory map.
+ *
+ * One entry per physical frame of RAM, recording who owns it. Frames
+ * below the first free address reported by ram_getfirstfree() hold
+ * the kernel image, the boot stack and everything stolen before the
+ * VM system came up; they are marked fixed and never handed out.
+ *
+ * Free frames are kept by a binary buddy allocator: a free block of
+ * order k is 2^k frames long, starts on a frame number that is a
+ * multiple of 2^k, and sits on the free list for order k. Allocation
+ * splits the smallest block that fits; freeing merges a block with
+ * its buddy for as long as the buddy is free too.
+ *
+ * Single pages, which is nearly everything, normally don't get as far
+ * as the buddy lists: each cpu keeps a small cache of free pages in
+ * struct cpu, and only goes to the coremap (and its lock) to refill
+ * or drain that cache half a cache at a time.
+ *
+ * For user pages the map also records the owning address space and
+ * virtual address, so the pageout code (pageout.c) can find the page
+ * table entry of a frame it wants to evict, and the swap slot holding
+ * a clean copy of the page, if any. A frame shared copy-on-write has
+ * no single owner and is never chosen for eviction.
+ *
+ * Each user frame has a busy bit that works as a sleeping lock (the
+ * "page lock"). It is held by whoever is changing how the frame is
+ * mapped: evicting it, writing it to swap, sharing it, or freeing
+ * it. The page table entry pointing at a frame only changes under
+ * that frame's page lock, so after locking the frame a caller can
+ * check that the entry it started from is still current.
+ */
+
+#include <vm.h>
+
+struct addrspace;
+
+/* Frame states */
+#define CM_FREE		0	/* available */
+#define CM_FIXED	1	/* kernel memory, never reclaimed */
+#define CM_KERNEL	2	/* kernel memory from alloc_kpages */
+#define CM_USER		3	/* user page */
+#define CM_CACHED	4	/* free, but held in a cpu's page cache */
+
+/* Largest block the buddy allocator deals in (2^CM_MAXORDER frames). */
+#define CM_MAXORDER	16
+
+/* ce_order value for frames that do not head a free block */
+#define CM_NOORDER	0xff
+
+/* ce_swapslot value for frames with no copy in swap */
+#define CM_NOSLOT	0xffffffff
+
+/* Arguments to coremap_pageout_victim */
+#define CM_VICTIM_CLEAN	1	/* has a valid copy in swap */
+#define CM_VICTIM_DIRTY	2	/* would have to be written out first */
+#define CM_VICTIM_ANY	(CM_VICTIM_CLEAN | CM_VICTIM_DIRTY)
+
+struct coremap_entry {
+	unsigned char ce_state;		/* CM_* above */
+	unsigned char ce_order;		/* order, if head of a free block */
+	unsigned short ce_refcount;	/* address spaces mapping a user page */
+	unsigned ce_npages;		/* block length, if head of allocation */
+	int ce_next;			/* free list links (frame numbers) */
+	int ce_prev;
+	struct addrspace *ce_as;	/* owner of a user page, or NULL */
+	vaddr_t ce_vaddr;		/* ...and where it is mapped there */
+	uintptr_t ce_sharers;		/* XOR of the sharing address spaces */
+	unsigned ce_swapslot;		/* clean copy in swap, or CM_NOSLOT */
+	bool ce_busy;			/* page lock */
+	bool ce_used;			/* referenced since the clock passed */
+	bool ce_cow;			/* ce_sharers is being kept */
+};
+
+/*
+ * Functions in coremap.c:
+ *
+ *    coremap_bootstrap  - take over physical memory from ram.c.
+ *
+ *    coremap_getkpages  - allocate NPAGES contiguous frames for kernel
+ *                         use. Returns 0 if none are available.
+ *
+ *    coremap_getupage   - allocate one frame for a user page. Returns
+ *                         0 if none is available.
+ *
+ *    coremap_freepages  - release a block obtained from
+ *                         coremap_getkpages.
+ *
+ *    coremap_freecount  - return the number of free frames (not
+ *                         counting those in cpu caches).
+ *
+ *    coremap_page_lock  - take the page lock on the user frame at
+ *                         PADDR, sleeping while somebody else has it.
+ *                         Returns false, without the lock, if the frame
+ *                         is no longer a user page. Must not be called
+ *                         holding spinlocks.
+ *
+ *    coremap_page_unlock - release the page lock.
+ *
+ *    coremap_upage_release - drop a reference to the locked user page
+ *                         at PADDR and release the page lock. AS is the
+ *                         address space whose mapping went away, or NULL
+ *                         if the reference was not a mapping. The frame
+ *                         is freed with the last reference; by then its
+ *                         swap slot must have been disposed of.
+ *
+ *    coremap_upage_share - add a reference to the locked user page at
+ *                         PADDR, which is now mapped by AS as well
+ *                         (copy-on-write fork), or by somebody unknown
+ *                         if AS is NULL. The page loses its owner
+ *                         while it is shared; if it had one, the sharers
+ *                         are tracked, and when only one of them is left
+ *                         it becomes the owner again.
+ *
+ *    coremap_upage_refs - return the number of references to the user
+ *                         page at PADDR. A page with one reference
+ *                         belongs to the caller alone.
+ *
+ *    coremap_upage_setowner - record that the user page at PADDR is
+ *                         mapped at VADDR in AS alone, which makes it
+ *                         a candidate for eviction; or, with AS NULL,
+ *                         that it is not. Call with the page locked,
+ *                         or on a new page not yet visible to others,
+ *                         and only once the page table entry is set.
+ *
+ *    coremap_upage_getslot/setslot - get or set the swap slot holding
+ *                         a clean copy of the locked user page at PADDR.
+ *
+ *    coremap_upage_touch - note that the user page at PADDR has been
+ *                         referenced, for the clock algorithm.
+ *
+ *    coremap_pageout_victim - advance the clock hand to an owned,
+ *                         unshared user page not referenced since the
+ *                         hand last passed and of the kind WANT asks
+ *                         for (CM_VICTIM_*), and return it locked, with
+ *                         its owner in AS and VADDR. Returns 0 if there
+ *                         is none.
+ *
+ *    coremap_printstats - print allocator statistics.
+ */
+
+void coremap_bootstrap(void);
+paddr_t coremap_getkpages(unsigned npages);
+paddr_t coremap_getupage(void);
+void coremap_freepages(paddr_t paddr);
+unsigned coremap_freecount(void);
+bool coremap_page_lock(paddr_t paddr);
+void coremap_page_unlock(paddr_t paddr);
+void coremap_upage_release(paddr_t paddr, struct addrspace *as);
+void coremap_upage_share(paddr_t paddr, struct addrspace *as);
+unsigned coremap_upage_refs(paddr_t paddr);
+void coremap_upage_setowner(paddr_t paddr, struct addrspace *as,
+			    vaddr_t vaddr);
+unsigned coremap_upage_getslot(paddr_t paddr);
+void coremap_upage_setslot(paddr_t paddr, unsigned slot);
+void coremap_upage_touch(paddr_t paddr);
+paddr_t coremap_pageout_victim(int want, struct addrspace **as,
+			       vaddr_t *vaddr);
+void coremap_printstats(void);
+
+
+#endif /* _COREMAP_H_ */
@@ -35,6 +35,12 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+/* Number of free pages each cpu may keep for itself (see coremap.c). */
+#define CPU_PAGECACHE_MAX 8
+
+/* Number of priority levels in each cpu's run queue (see thread.c). */
+#define SCHED_NLEVELS 8
+
 
 /*
  * Per-cpu structure
@@ -62,12 +68,56 @@ struct cpu {
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
+	/*
+	 * Protected by c_pagecache_lock, which is normally taken only
+	 * by this cpu; others take it to find pages when memory runs
+	 * out. Free single pages kept back from the coremap so that
+	 * most page allocations don't need the coremap lock.
+	 */
+	struct spinlock c_pagecache_lock;
+	paddr_t c_pagecache[CPU_PAGECACHE_MAX];
+	unsigned c_pagecache_count;
+	unsigned c_pagecache_allocs;	/* Pages handed out from here */
+	unsigned c_pagecache_frees;	/* Pages given back here */
+	int c_pagecache_nkernel;	/* Net kernel pages handed out */
+	int c_pagecache_nuser;		/* Net user pages handed out */
+
+	/*
+	 * Accessed only by this cpu, with interrupts off.
+	 * TLB replacement state and statistics (see vm_tlb.c).
+	 */
+	unsigned c_tlb_victim;		/* Next TLB slot to replace */
+	unsigned c_tlb_filled;		/* Slots used since the last flush */
+	int c_tlb_hole;			/* A slot invalidated since, or -1 */
+	unsigned c_tlb_misses;		/* TLB misses handled */
+	unsigned c_tlb_refills;		/* ...answered by the page table */
+	unsigned c_tlb_readonly;	/* Writes to read-only TLB entries */
+	unsigned c_tlb_evictions;	/* Valid TLB entries replaced */
+
+	/*
+	 * Written only by this cpu, with interrupts off; read by
+	 * other cpus to decide whom to send TLB shootdowns to.
+	 */
+	struct addrspace *c_tlb_as;	/* Address space in the TLB */
+
+	/*
+	 * Accessed only by this cpu.
+	 * Work stealing statistics (see thread.c).
+	 */
+	unsigned c_steals;		/* Successful steals from other cpus */
+	unsigned c_migrations;		/* Threads taken by those steals */
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the runqueue lock.
+	 *
+	 * The run queue has one list per priority level, highest
+	 * (level 0) first; c_runqueue_count is the total. The count
+	 * may be read without the lock where a stale value is harmless.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_runqueue[SCHED_NLEVELS]; /* Run queue for this cpu */
+	unsigned c_runqueue_count;	/* Threads on the run queue */
 	struct spinlock c_runqueue_lock;
 
 	/*
@@ -77,7 +127,9 @@ struct cpu {
 	 * TLB shootdown requests made to this CPU are queued in
 	 * c_shootdown[], with c_numshootdown holding the number of
 	 * requests. TLBSHOOTDOWN_MAX is the maximum number that can
-	 * be queued at once, which is machine-dependent.
+	 * be queued at once, which is machine-dependent; past that,
+	 * c_shootdown_all is set and the whole TLB is flushed instead.
+	 * c_shootdown_gen counts the batches of requests handled.
 	 *
 	 * The contents of struct tlbshootdown are also machine-
 	 * dependent and might reasonably be either an address space
@@ -86,6 +138,8 @@ struct cpu {
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	unsigned c_numshootdown;
+	bool c_shootdown_all;
+	unsigned c_shootdown_gen;
 	struct spinlock c_ipi_lock;
 
 	/*
@@ -112,6 +166,15 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Iterate over cpus, e.g. to collect per-cpu statistics.
+ *
+ * cpu_count returns the number of cpus; cpu_get returns the cpu
+ * with software number N (0 <= N < cpu_count()).
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned n);
+
 /*
  * Produce a string describing the CPU type.
  */
@@ -155,6 +218,8 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * It returns the value the target's c_shootdown_gen will have reached
+ * once the request has been handled.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -168,7 +233,8 @@ void cpu_halt(void);
 
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
-void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown(struct cpu *target,
+			  const struct tlbshootdown *mapping);
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,57 @@
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Per-process file descriptor table.
+ *
+ * A file descriptor is an index into ft_files, whose entries point to
+ * shared, reference counted open files (see openfile.h), or are NULL
+ * if the descriptor is not in use. The table belongs to the single
+ * thread of its process, which is the only one that looks at it, so
+ * it needs no lock of its own.
+ */
+
+#include <limits.h>
+
+struct openfile;
+
+struct filetable {
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+/*
+ * Functions in filetable.c:
+ *
+ *    filetable_create  - create an empty table. Returns NULL on
+ *                        out-of-memory error.
+ *
+ *    filetable_destroy - close everything still open and free the
+ *                        table.
+ *
+ *    filetable_copy    - create a table with the same descriptors as
+ *                        SRC, referring to the same open files (as
+ *                        for fork).
+ *
+ *    filetable_get     - look up FD. Fails with EBADF if it is not an
+ *                        open descriptor. No reference is added; the
+ *                        result is good until the caller closes FD.
+ *
+ *    filetable_place   - put OF in the lowest unused descriptor and
+ *                        return it in FD. The table takes over the
+ *                        caller's reference. Fails with EMFILE if the
+ *                        table is full.
+ *
+ *    filetable_remove  - take FD out of the table and hand back its
+ *                        open file in OF, with the reference the
+ *                        table had. Fails with EBADF.
+ */
+
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+int filetable_remove(struct filetable *ft, int fd, struct openfile **ret);
+
+
+#endif /* _FILETABLE_H_ */
@@ -34,6 +34,12 @@
  * ioctl operation codes
  */
 
-/* (none yet) */
+/*
+ * Console: set the input mode. The argument points to an int, nonzero
+ * for canonical mode (the console collects and echoes whole lines,
+ * with erase and kill) and zero for raw mode (each character is
+ * passed on as typed, without echo). Raw is the default.
+ */
+#define IOCTL_CON_SETCANON	1
 
 #endif /* _KERN_IOCTL_H_*/
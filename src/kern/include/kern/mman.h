@@ -0,0 +1,23 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Definitions for mmap() and munmap().
+ */
+
+/* Page protection (prot argument). */
+#define PROT_NONE    0
+#define PROT_READ    1
+#define PROT_WRITE   2
+#define PROT_EXEC    4
+
+/* Mapping type (flags argument). Exactly one of these is required. */
+#define MAP_SHARED   0x0001	/* Changes are shared and go to the file. */
+#define MAP_PRIVATE  0x0002	/* Changes are private (copy-on-write). */
+
+/* Other flags. */
+#define MAP_FIXED    0x0010	/* Map exactly at the address given. */
+#define MAP_ANON     0x1000	/* Anonymous zero-filled memory; no file. */
+#define MAP_ANONYMOUS MAP_ANON
+
+#endif /* _KERN_MMAN_H_ */
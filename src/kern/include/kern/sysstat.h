@@ -0,0 +1,23 @@
+#ifndef _KERN_SYSSTAT_H_
+#define _KERN_SYSSTAT_H_
+
+/*
+ * Per-system-call statistics, as returned by the __sysstat() system
+ * call: one record for each call the kernel implements.
+ *
+ * ss_nsecs is the total time spent in the call, from dispatch to
+ * return. Calls that do not return (_exit, and execv when it
+ * succeeds) are counted but not timed.
+ */
+
+#define SYSSTAT_NAMELEN	16
+
+struct sysstat {
+	char ss_name[SYSSTAT_NAMELEN];	/* name, null-terminated */
+	int ss_callno;			/* SYS_* number */
+	__u32 ss_calls;			/* times called */
+	__u64 ss_nsecs;			/* total time in the call */
+};
+
+
+#endif /* _KERN_SYSSTAT_H_ */
@@ -55,6 +55,13 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Stop and restart the current CPU's hardclock, so an idle CPU isn't
+ * woken up HZ times a second for nothing. (Low-level.)
+ */
+void mainbus_hardclock_stop(void);
+void mainbus_hardclock_start(void);
+
 /* Request breaking into the debugger, where available. */
 void mainbus_debugger(void);
 
@@ -0,0 +1,58 @@
+#ifndef _OPENFILE_H_
+#define _OPENFILE_H_
+
+/*
+ * Open file objects.
+ *
+ * An openfile is what a file descriptor refers to: an open vnode plus
+ * the state that goes with opening it, namely the access mode and
+ * the seek position. Descriptors copied by fork share the same
+ * openfile, and so share the seek position, as in Unix; the
+ * openfile is reference counted and closes the vnode when the last
+ * descriptor referring to it goes away.
+ *
+ * of_lock serializes I/O on seekable files, so that concurrent reads
+ * and writes through a shared openfile each see and update a
+ * consistent offset. It is not taken for devices like the console,
+ * which have no position and where a read may block indefinitely.
+ */
+
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;		/* the file */
+	int of_accmode;			/* O_RDONLY, O_WRONLY or O_RDWR */
+	bool of_append;			/* O_APPEND: writes go at the end */
+	bool of_seekable;		/* has a position */
+	off_t of_offset;		/* current position */
+	struct lock *of_lock;		/* protects of_offset */
+	unsigned of_refcount;		/* descriptors referring to this */
+	struct spinlock of_reflock;	/* protects of_refcount */
+};
+
+/*
+ * Functions in openfile.c:
+ *
+ *    openfile_create - make an openfile with one reference for V, as
+ *                      opened with FLAGS. Takes over the caller's
+ *                      reference to V.
+ *
+ *    openfile_open   - open PATH with FLAGS and MODE as for open(),
+ *                      and return a new openfile with one reference.
+ *                      May destroy PATH (it goes to vfs_open).
+ *
+ *    openfile_incref - add a reference.
+ *
+ *    openfile_decref - drop a reference; the last one closes the file.
+ */
+
+int openfile_create(struct vnode *v, int flags, struct openfile **ret);
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+
+#endif /* _OPENFILE_H_ */
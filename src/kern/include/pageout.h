@@ -0,0 +1,54 @@
+#ifndef _PAGEOUT_H_
+#define _PAGEOUT_H_
+
+/*
+ * Page replacement.
+ *
+ * When no free frame is left, a user page is evicted to swap. Victims
+ * are chosen by the clock (second chance) algorithm over the coremap:
+ * a page referenced since the hand last passed it is spared once.
+ * Clean pages, whose swap copy is still valid, are taken in preference
+ * to dirty ones, since evicting them needs no I/O. An untouched page
+ * of a read-only segment is clean too, with the executable as its
+ * copy: it is simply dropped, and read in again on the next fault.
+ *
+ * To keep clean pages available, a pageout daemon wakes up whenever
+ * free memory drops below PAGEOUT_LOWAT frames and writes back up to
+ * PAGEOUT_BATCH dirty pages ahead of demand. Only if it falls behind
+ * does a faulting thread have to write a victim out itself.
+ */
+
+#include <vm.h>
+
+/* Wake the daemon when fewer than this many frames are free. */
+#define PAGEOUT_LOWAT	8
+
+/* Dirty pages the daemon writes back each time it wakes. */
+#define PAGEOUT_BATCH	8
+
+/*
+ * Functions in pageout.c:
+ *
+ *    pageout_bootstrap  - start the pageout daemon, if there is swap.
+ *
+ *    pageout_evict      - free one frame by paging something out.
+ *                         Returns ENOMEM if nothing can be evicted.
+ *                         May sleep.
+ *
+ *    pageout_getupage   - allocate a frame for a user page, evicting
+ *                         one if none is free. Returns 0 if nothing
+ *                         can be evicted either. May sleep.
+ *
+ *    pageout_wakeup     - tell the daemon memory is getting short.
+ *
+ *    pageout_printstats - print eviction counts.
+ */
+
+void pageout_bootstrap(void);
+int pageout_evict(void);
+paddr_t pageout_getupage(void);
+void pageout_wakeup(void);
+void pageout_printstats(void);
+
+
+#endif /* _PAGEOUT_H_ */
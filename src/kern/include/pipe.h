@@ -0,0 +1,37 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes.
+ *
+ * A pipe is a PIPE_SIZE ring buffer with two vnodes, one for each end.
+ * Reads and writes uiomove straight between the user buffer and the
+ * ring, so data is copied once on the way in and once on the way out.
+ *
+ * A reader sleeps only while the pipe is empty and a writer only while
+ * it is full, so the ring going from empty to non-empty and from full
+ * to non-full are the only points where anyone has to be woken.
+ *
+ * When the last reference to the write end goes away, readers see end
+ * of file once the pipe drains; when the read end goes, writes fail
+ * with EPIPE. The pipe is freed with the second of its ends.
+ */
+
+#include <vm.h>
+
+#define PIPE_SIZE PAGE_SIZE
+
+struct vnode;
+
+/*
+ * Functions in pipe.c:
+ *
+ *    pipe_create - make a pipe and return a vnode for its read end in
+ *                  RV and one for its write end in WV, each with one
+ *                  reference.
+ */
+
+int pipe_create(struct vnode **rv, struct vnode **wv);
+
+
+#endif /* _PIPE_H_ */
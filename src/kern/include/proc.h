@@ -38,10 +38,12 @@
 
 #include <spinlock.h>
 #include "opt-waitpid.h"
+#include "opt-syscalls.h"
 
 struct addrspace;
 struct thread;
 struct vnode;
+struct filetable;
 
 /*
  * Process structure.
@@ -61,33 +63,40 @@ struct vnode;
  * without sleeping.
  */
 
-#if OPT_WAITPID
-/* G.Cabodi - implement waitpid: 
-   synch with semaphore (1) or cond.var.(0) */
-#define USE_SEMAPHORE_FOR_WAITPID 1
-#endif
+/*
+ * With waitpid, a process that exits stays around as a zombie, with
+ * its exit status and nothing else, until its parent collects it.
+ * Each process has one wait queue (p_waitcv) for its children's
+ * exits, rather than one per child. Programs started from the menu
+ * are children of the kernel process, which waits for them. Orphans
+ * have no parent and are destroyed as they exit.
+ */
 
 struct proc {
 	char *p_name;			/* Name of this process */
 	struct spinlock p_lock;		/* Lock for this structure */
 	unsigned p_numthreads;		/* Number of threads in this process */
+	int p_nice;			/* Nice value for its threads */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
+#if OPT_SYSCALLS
+	struct filetable *p_filetable;	/* open file descriptors */
+#endif
 
 	/* add more material here as needed */
 #if OPT_WAITPID
         int p_status;                   /* status as obtained by exit() */
         pid_t p_pid;                    /* process pid */
-#if USE_SEMAPHORE_FOR_WAITPID
-	struct semaphore *p_sem;
-#else
-        struct cv *p_cv;
-        struct lock *p_lock;
-#endif
+	/* process tree; protected by the pid table lock (proc.c) */
+	struct proc *p_parent;		/* parent, or NULL */
+	struct proc *p_children;	/* first child */
+	struct proc *p_sibling;		/* next child of the same parent */
+	bool p_exited;			/* is a zombie */
+	struct cv *p_waitcv;		/* where we wait for children */
 #endif
 };
 
@@ -100,6 +109,11 @@ void proc_bootstrap(void);
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
+#if OPT_SYSCALLS
+/* Create a copy of the current process for fork(). */
+int proc_fork(struct proc **ret);
+#endif
+
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
@@ -115,9 +129,34 @@ struct addrspace *proc_getas(void);
 /* Change the address space of the current process, and return the old one. */
 struct addrspace *proc_setas(struct addrspace *);
 
-/* wait for process termination, and return exit status */
-int proc_wait(struct proc *proc);
-/* get proc from pid */
+/*
+ * Exit the current process with STATUS (as encoded by <kern/wait.h>):
+ * release its resources and detach the current thread, leaving a
+ * zombie for the parent, if any. The caller goes on to thread_exit.
+ */
+void proc_exit(int status);
+
+#if OPT_WAITPID
+/*
+ * Wait for the child PID of the current process to exit, and return
+ * the zombie, which the caller disposes of with proc_destroy. With
+ * NOHANG, return NULL instead of waiting if it has not exited yet.
+ */
+int proc_waitchild(pid_t pid, bool nohang, struct proc **ret);
+#endif
+
+#if OPT_WAITPID
+/*
+ * Set or get the nice value (PRIO_MIN..PRIO_MAX) of process PID, or
+ * of the current process if PID is 0. The process's threads pick up
+ * a new value at their next hardclock. ESRCH if there is no such
+ * live process.
+ */
+int proc_setnice(pid_t pid, int nice);
+int proc_getnice(pid_t pid, int *ret);
+#endif
+
+/* get proc from pid; NULL if there is none */
 struct proc *proc_search_pid(pid_t pid);
 
 #endif /* _PROC_H_ */
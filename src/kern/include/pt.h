@@ -0,0 +1,79 @@
+#ifndef _PT_H_
+#define _PT_H_
+
+/*
+ * Per-process page table.
+ *
+ * Two-level table indexed by virtual page number: the top 10 bits of
+ * the address select a second-level table, the next 10 bits select
+ * the entry. Second-level tables are allocated only when a page in
+ * their 4M range is first touched, so a sparse address space (code
+ * at the bottom, stack at the top) costs a handful of pages.
+ *
+ * A page table entry is a 32-bit word. A zero entry means the page
+ * has never been touched: the fault handler fills it according to
+ * the region it belongs to (demand-zero). A resident page has
+ * PTE_PRESENT set and its frame address in PTE_FRAME; a page that
+ * has been paged out has PTE_SWAPPED set and its swap slot number
+ * in the same bits.
+ *
+ * PTE_DIRTY is set when the frame may differ from its copy in swap
+ * (or has none). Clean pages are mapped read-only in the TLB so that
+ * the first write faults and clears the copy; see vm_fault. A clean
+ * page with no swap copy comes from a read-only part of an executable
+ * and can be read from there again.
+ */
+
+#include <vm.h>
+
+/* Page table entry fields */
+#define PTE_FRAME	0xfffff000	/* physical frame address */
+#define PTE_PRESENT	0x00000001	/* frame is resident */
+#define PTE_WRITE	0x00000002	/* page may be written */
+#define PTE_DIRTY	0x00000004	/* frame has no valid swap copy */
+#define PTE_SWAPPED	0x00000008	/* page is in swap */
+
+#define PTE_SLOT(pte)	((pte) >> PT_L2_SHIFT)	/* swap slot, if swapped */
+#define PTE_MKSWAP(slot) (((uint32_t)(slot) << PT_L2_SHIFT) | PTE_SWAPPED)
+#define PTE_MAXSLOTS	(1U << (32 - PT_L2_SHIFT))
+
+#define PT_L1_SHIFT	22
+#define PT_L2_SHIFT	12
+#define PT_L2_SIZE	1024
+#define PT_L1_SIZE	(USERSPACETOP >> PT_L1_SHIFT)	/* user space only */
+
+#define PT_L1_INDEX(va)	((va) >> PT_L1_SHIFT)
+#define PT_L2_INDEX(va)	(((va) >> PT_L2_SHIFT) & (PT_L2_SIZE - 1))
+
+struct pagetable {
+	uint32_t *pt_dir[PT_L1_SIZE];	/* second-level tables, or NULL */
+};
+
+/*
+ * Functions in pt.c:
+ *
+ *    pt_create  - allocate an empty page table. Returns NULL on
+ *                 out-of-memory error.
+ *
+ *    pt_destroy - free the table itself. Does not touch the frames
+ *                 the entries refer to; the caller releases those
+ *                 first (see as_destroy).
+ *
+ *    pt_lookup  - return a pointer to the entry for VADDR. If the
+ *                 second-level table is missing, allocate it when
+ *                 CREATE is set, otherwise return NULL. May sleep
+ *                 when CREATE is set.
+ *
+ *    pt_walk    - call FUNC on every nonzero entry, in address order.
+ *                 Stops and returns the first nonzero result.
+ */
+
+struct pagetable *pt_create(void);
+void pt_destroy(struct pagetable *pt);
+uint32_t *pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create);
+int pt_walk(struct pagetable *pt,
+	    int (*func)(vaddr_t vaddr, uint32_t *pte, void *data),
+	    void *data);
+
+
+#endif /* _PT_H_ */
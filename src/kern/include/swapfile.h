@@ -0,0 +1,55 @@
+#ifndef _SWAPFILE_H_
+#define _SWAPFILE_H_
+
+/*
+ * Swap space.
+ *
+ * Pages evicted from memory go to the raw disk SWAP_DEVICE, divided
+ * into page-sized slots. A bitmap records which slots are in use.
+ * Each slot also has a reference count, since after fork two address
+ * spaces can refer to the same swapped-out page.
+ *
+ * If the device cannot be attached the system runs without swap:
+ * swap_alloc always fails and nothing is ever paged out.
+ */
+
+#include <vm.h>
+
+#define SWAP_DEVICE "lhd1:"
+
+/*
+ * Functions in swapfile.c:
+ *
+ *    swap_bootstrap   - attach the swap device.
+ *
+ *    swap_enabled     - return true if there is swap to page out to.
+ *
+ *    swap_alloc       - allocate a slot with one reference, returned
+ *                       in SLOT. Fails with ENOSPC if swap is full.
+ *
+ *    swap_share       - add a reference to SLOT.
+ *
+ *    swap_free        - drop a reference to SLOT, releasing it when
+ *                       the last one goes.
+ *
+ *    swap_refs        - return the number of references to SLOT.
+ *
+ *    swap_in          - read SLOT into the frame at PADDR. Sleeps.
+ *
+ *    swap_out         - write the frame at PADDR to SLOT. Sleeps.
+ *
+ *    swap_printstats  - print slot usage and paging counts.
+ */
+
+void swap_bootstrap(void);
+bool swap_enabled(void);
+int swap_alloc(unsigned *slot);
+void swap_share(unsigned slot);
+void swap_free(unsigned slot);
+unsigned swap_refs(unsigned slot);
+int swap_in(unsigned slot, paddr_t paddr);
+int swap_out(paddr_t paddr, unsigned slot);
+void swap_printstats(void);
+
+
+#endif /* _SWAPFILE_H_ */
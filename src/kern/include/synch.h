@@ -71,20 +71,35 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * The lock is adaptive: a thread that finds it held spins as long as
+ * the owner is running on another cpu, as it is then likely to let go
+ * soon, and sleeps otherwise. Statistics are kept for each lock name
+ * (see lock_printstats).
  */
+struct lockstat;
+
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
         // add what you need here
         // (don't forget to mark things volatile as needed)
 
-        #if USE_SEMAPHORE_LOCK
+        #if USE_SEMAPHORE_FOR_LOCK
                 struct semaphore *lk_sem;
         #else   
                 struct wchan *lk_wchan;
         #endif
                 struct spinlock lk_lock;
                 volatile struct thread *lk_owner;
+
+        /* Statistics; the lk_* below are the owner's to touch. */
+        struct lockstat *lk_stat;       /* shared by locks of this name */
+        unsigned lk_holds;              /* times acquired */
+        uint64_t lk_acquired;           /* when the owner got it, in ns,
+                                           if this hold is being timed */
+        bool lk_spun;                   /* the owner spun for it */
+        bool lk_slept;                  /* the owner slept for it */
 };
 
 struct lock *lock_create(const char *name);
@@ -105,6 +120,13 @@ void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+/*
+ * Print, for each lock name, how many times locks of that name were
+ * acquired, how many of those spun or slept waiting, and the average
+ * time they were held (over a sample of the holds).
+ */
+void lock_printstats(void);
+
 
 /*
  * Condition variable.
@@ -34,8 +34,12 @@
 #include <cdefs.h> /* for __DEAD */
 
 #include "opt-syscalls.h"
+#include "opt-dumbvm.h"
+#include "opt-waitpid.h"
 
 struct trapframe; /* from <machine/trapframe.h> */
+struct vnode;
+struct argblock;
 
 /*
  * The system call dispatcher.
@@ -47,8 +51,15 @@ void syscall(struct trapframe *tf);
  * Support functions.
  */
 
-/* Helper for fork(). You write this. */
-void enter_forked_process(struct trapframe *tf);
+/* Per-call counts and times; see syscall.c. */
+void syscall_bootstrap(void);
+void syscall_printstats(void);
+
+/* Enter user mode in the child of fork. Does not return. */
+__DEAD void enter_forked_process(struct trapframe *tf);
+
+/* Run a new program in the current process; see runprogram.c. */
+int exec_program(struct vnode *v, struct argblock *ab);
 
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
@@ -61,14 +72,43 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t req, userptr_t rem);
+int sys___sysstat(userptr_t buf, int n, int32_t *retval);
+
+#if !OPT_DUMBVM
+int sys_sbrk(intptr_t amount, int32_t *retval);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	     off_t offset, int32_t *retval);
+int sys_munmap(userptr_t addr, size_t len);
+#endif
 
  // -----------------------------------------------
 #if OPT_SYSCALLS
- int sys_write(int fd, userptr_t buf_ptr, size_t size);
- int sys_read(int fd, userptr_t buf_ptr, size_t size);
- void sys__exit(int status);
-
- int sys_waitpid(pid_t pid, userptr_t statusp, int options);
+int sys_open(userptr_t path, int flags, mode_t mode, int32_t *retval);
+int sys_close(int fd);
+int sys_pipe(userptr_t fds);
+int sys_read(int fd, userptr_t buf, size_t len, int32_t *retval);
+int sys_write(int fd, userptr_t buf, size_t len, int32_t *retval);
+int sys_pread(int fd, userptr_t buf, size_t len, off_t pos, int32_t *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t len, off_t pos, int32_t *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int32_t *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int32_t *retval);
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	       int32_t *retval);
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+		int32_t *retval);
+int sys_lseek(int fd, off_t pos, int whence, off_t *retval);
+int sys_ioctl(int fd, int code, userptr_t data);
+int sys_execv(userptr_t prog, userptr_t argv);
+__DEAD void sys__exit(int code);
+#if OPT_WAITPID
+int sys_fork(struct trapframe *tf, int32_t *retval);
+int sys_getpid(int32_t *retval);
+int sys_waitpid(pid_t pid, userptr_t statusp, int options,
+		int32_t *retval);
+int sys_setpriority(int which, pid_t who, int prio);
+int sys_getpriority(int which, pid_t who, int32_t *retval);
+#endif
 
 #endif
 
@@ -94,9 +94,11 @@ int kmallocstress(int, char **);
 int kmalloctest3(int, char **);
 int kmalloctest4(int, char **);
 int nettest(int, char **);
+int ticktest(int, char **);
 
 /* Routine for running a user-level program. */
-int runprogram(char *progname);
+struct argblock;
+int runprogram(char *progname, struct argblock *ab);
 
 /* Kernel menu system. */
 void menu(char *argstr);
@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct trapframe;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -85,6 +86,14 @@ struct thread {
 	struct proc *t_proc;		/* Process thread belongs to */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
 
+	/*
+	 * Scheduler fields (see thread.c). Changed only by the cpu
+	 * the thread is on, or while it is not on any run queue.
+	 */
+	unsigned t_level;		/* Run queue level; 0 is highest */
+	unsigned t_ticks;		/* Hardclocks used at this level */
+	int t_nice;			/* Nice value, PRIO_MIN..PRIO_MAX */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -145,6 +154,14 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread goes straight to user mode
+ * with a copy of the trapframe TF, as the child of fork. The copy is
+ * made on the new thread's own kernel stack.
+ */
+int thread_fork_trapframe(const char *name, struct proc *proc,
+			  const struct trapframe *tf);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -158,16 +175,22 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Charge the current thread for one hardclock. Returns true if it
+ * should yield: it has used up its quantum, or a thread of higher
+ * priority is waiting. Called from the timer interrupt.
+ */
+bool thread_hardclock(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
 void schedule(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Print per-cpu scheduler statistics.
  */
-void thread_consider_migration(void);
+void thread_printstats(void);
 
 
 #endif /* _THREAD_H_ */
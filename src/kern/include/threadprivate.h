@@ -33,6 +33,7 @@
 struct thread;		/* from <thread.h> */
 struct thread_machdep;	/* from <machine/thread.h> */
 struct switchframe;	/* from <machine/switchframe.h> */
+struct trapframe;	/* from <machine/trapframe.h> */
 
 
 /*
@@ -73,6 +74,8 @@ void switchframe_switch(struct switchframe **prev, struct switchframe **next);
 void switchframe_init(struct thread *,
 		      void (*entrypoint)(void *data1, unsigned long data2),
 		      void *data1, unsigned long data2);
+void switchframe_init_trapframe(struct thread *,
+				const struct trapframe *tf);
 
 
 #endif /* _THREADPRIVATE_H_ */
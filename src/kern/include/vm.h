@@ -57,6 +57,7 @@ void free_kpages(vaddr_t addr);
 
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
+void vm_tlbshootdown_all(void);
 
 
 #endif /* _VM_H_ */
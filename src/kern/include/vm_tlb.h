@@ -0,0 +1,61 @@
+#ifndef _VM_TLB_H_
+#define _VM_TLB_H_
+
+/*
+ * TLB management for the paged VM system.
+ *
+ * When the TLB is full, the entry to replace is chosen round-robin:
+ * each cpu keeps a victim pointer in struct cpu that walks the slots
+ * in order, which approximates FIFO at no cost. Setting VM_TLB_RANDOM
+ * below switches to the hardware's random replacement (tlb_random)
+ * instead. Slots left empty since the last flush are used first (a
+ * count of them is kept, so finding one needs no scan), as is the
+ * slot most recently emptied by a shootdown. A page already in the
+ * TLB (e.g. being upgraded to writeable) is replaced in place.
+ *
+ * Each cpu also counts TLB misses, misses refilled straight from the
+ * page table, writes to read-only entries (which are not misses), and
+ * valid entries evicted to make room.
+ */
+
+#include <vm.h>
+
+struct addrspace;
+
+#define VM_TLB_RANDOM 0
+
+/*
+ * Functions in vm_tlb.c:
+ *
+ *    vm_tlb_flush      - invalidate every entry in this cpu's TLB.
+ *
+ *    vm_tlb_activate   - flush this cpu's TLB and record that it now
+ *                        holds translations for AS.
+ *
+ *    vm_tlb_load       - enter the translation EHI -> ELO, evicting
+ *                        an entry if necessary.
+ *
+ *    vm_tlb_shootdown  - remove any translation for VADDR in AS from
+ *                        every cpu's TLB, and wait until that is done.
+ *                        Only cpus running AS are interrupted. Used
+ *                        when a page is taken away or write-protected.
+ *                        Must not be called holding spinlocks.
+ *
+ *    vm_tlb_miss       - count a fault of type FAULTTYPE on this cpu:
+ *                        a TLB miss, or for VM_FAULT_READONLY a write
+ *                        to a read-only entry, counted separately.
+ *                        REFILL is set when the page table alone could
+ *                        resolve a miss.
+ *
+ *    vm_tlb_printstats - print the per-cpu counters.
+ */
+
+void vm_tlb_flush(void);
+void vm_tlb_activate(struct addrspace *as);
+void vm_tlb_load(uint32_t ehi, uint32_t elo);
+void vm_tlb_shootdown(struct addrspace *as, vaddr_t vaddr);
+void vm_tlb_miss(int faulttype, bool refill);
+void vm_tlb_printstats(void);
+
+
+#endif /* _VM_TLB_H_ */
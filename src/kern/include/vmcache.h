@@ -0,0 +1,76 @@
+#ifndef _VMCACHE_H_
+#define _VMCACHE_H_
+
+/*
+ * Page cache for mapped files.
+ *
+ * Each page of a file that somebody has mapped with mmap is read into
+ * memory once and kept in a hash table keyed by vnode and offset.
+ * Every address space mapping the page maps that same frame: shared
+ * mappings read and write it directly, private ones read it and get a
+ * copy of their own on the first write (copy-on-write, as after fork).
+ *
+ * The cache holds a reference of its own to each frame (and to the
+ * vnode). A cached frame therefore never has a single owner, so the
+ * pageout code leaves it alone. When the last mapping of a page goes
+ * away, vmcache_release writes it back to the file if it may have
+ * been written, and frees it.
+ *
+ * So that mapped files cannot tie up all of memory, the cache holds
+ * at most 1/VMCACHE_MEMSHARE of the frames free at boot. When it is
+ * full it evicts a page: the cache knows every region mapping a file
+ * (vmcache_addmap), so it can clear their page table entries, after
+ * which the next access faults the page back in from the file.
+ *
+ * The cache is not coherent with read() and write() on the same file:
+ * changes made through a shared mapping reach the file when the page
+ * is unmapped everywhere.
+ */
+
+#include <vm.h>
+
+struct vnode;
+struct vmregion;
+
+/* Number of hash chains. */
+#define VMCACHE_HASHSIZE	64
+
+/* Share of memory (1/N) the cache may use. */
+#define VMCACHE_MEMSHARE	4
+
+/*
+ * Functions in vmcache.c:
+ *
+ *    vmcache_bootstrap  - set up the cache.
+ *
+ *    vmcache_addmap     - note that region VR now maps a file.
+ *
+ *    vmcache_delmap     - note that region VR is about to go away.
+ *
+ *    vmcache_get        - return in PADDR the frame holding the page of
+ *                         V at OFFSET (page aligned), reading it in if
+ *                         it is not cached. The caller gets a reference
+ *                         to the frame and maps it. WRITE says the
+ *                         mapping may write the page, which then has
+ *                         to be written back later. Fails with ENOMEM
+ *                         if the cache is full and nothing in it can
+ *                         be evicted. May sleep.
+ *
+ *    vmcache_release    - called after a mapping of the page of V at
+ *                         OFFSET has been dropped. If nobody maps the
+ *                         page any more, write it back as needed and
+ *                         evict it. Harmless if the page is not cached
+ *                         or still in use. May sleep.
+ *
+ *    vmcache_printstats - print cache statistics.
+ */
+
+void vmcache_bootstrap(void);
+void vmcache_addmap(struct vmregion *vr);
+void vmcache_delmap(struct vmregion *vr);
+int vmcache_get(struct vnode *v, off_t offset, bool write, paddr_t *paddr);
+void vmcache_release(struct vnode *v, off_t offset);
+void vmcache_printstats(void);
+
+
+#endif /* _VMCACHE_H_ */
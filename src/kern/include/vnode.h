@@ -120,9 +120,10 @@ struct vnode {
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
- *    vop_mmap        - Map file into memory. If you implement this
- *                      feature, you're responsible for choosing the
- *                      arguments for this operation.
+ *    vop_mmap        - Check whether the file can be mapped into memory.
+ *                      The VM system does the mapping itself, reading
+ *                      and writing the pages with vop_read and
+ *                      vop_write; see vmcache.h.
  *
  *    vop_truncate    - Forcibly set size of file to the length passed
  *                      in, discarding any excess blocks.
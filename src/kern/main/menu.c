@@ -43,8 +43,18 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <coremap.h>
+#include <argblock.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-dumbvm.h"
+
+#if !OPT_DUMBVM
+#include <vm_tlb.h>
+#include <swapfile.h>
+#include <pageout.h>
+#include <vmcache.h>
+#endif
 
 /*
  * In-kernel menu and command dispatcher.
@@ -60,38 +70,36 @@
 
 /*
  * Function for a thread that runs an arbitrary userlevel program by
- * name.
- *
- * Note: this cannot pass arguments to the program. You may wish to
- * change it so it can, because that will make testing much easier
- * in the future.
+ * name, passing it the rest of the arguments. PTR is a kmalloc'd
+ * argument block, which becomes ours.
  *
  * It copies the program name because runprogram destroys the copy
  * it gets by passing it to vfs_open().
  */
 static
 void
-cmd_progthread(void *ptr, unsigned long nargs)
+cmd_progthread(void *ptr, unsigned long unused)
 {
-	char **args = ptr;
+	struct argblock ab;
 	char progname[128];
 	int result;
 
-	KASSERT(nargs >= 1);
+	(void)unused;
 
-	if (nargs > 2) {
-		kprintf("Warning: argument passing from menu not supported\n");
-	}
+	/* Keep the block on our stack; runprogram never returns. */
+	ab = *(struct argblock *)ptr;
+	kfree(ptr);
 
 	/* Hope we fit. */
-	KASSERT(strlen(args[0]) < sizeof(progname));
+	KASSERT(strlen(argblock_arg(&ab, 0)) < sizeof(progname));
 
-	strcpy(progname, args[0]);
+	strcpy(progname, argblock_arg(&ab, 0));
 
-	result = runprogram(progname);
+	result = runprogram(progname, &ab);
 	if (result) {
-		kprintf("Running program %s failed: %s\n", args[0],
-			strerror(result));
+		kprintf("Running program %s failed: %s\n",
+			argblock_arg(&ab, 0), strerror(result));
+		argblock_cleanup(&ab);
 		return;
 	}
 
@@ -101,42 +109,65 @@ cmd_progthread(void *ptr, unsigned long nargs)
 /*
  * Common code for cmd_prog and cmd_shell.
  *
- * Note that this does not wait for the subprogram to finish, but
- * returns immediately to the menu. This is usually not what you want,
- * so you should have it call your system-calls-assignment waitpid
- * code after forking.
- *
- * Also note that because the subprogram's thread uses the "args"
- * array and strings, until you do this a race condition exists
- * between that code and the menu input code.
+ * The arguments are copied into an argument block before the new
+ * thread starts, since "args" and its strings belong to the menu's
+ * input buffer. The menu then waits for the program to finish, so
+ * the two don't compete for console input.
  */
 static
 int
 common_prog(int nargs, char **args)
 {
+	struct argblock *ab;
 	struct proc *proc;
 	int result;
 
+	ab = kmalloc(sizeof(*ab));
+	if (ab == NULL) {
+		return ENOMEM;
+	}
+	result = argblock_kinit(ab, nargs, args);
+	if (result) {
+		kfree(ab);
+		return result;
+	}
+
 	/* Create a process for the new program to run in. */
 	proc = proc_create_runprogram(args[0] /* name */);
 	if (proc == NULL) {
+		argblock_cleanup(ab);
+		kfree(ab);
 		return ENOMEM;
 	}
 
 	result = thread_fork(args[0] /* thread name */,
 			proc /* new process */,
 			cmd_progthread /* thread function */,
-			args /* thread arg */, nargs /* thread arg */);
+			ab /* thread arg */, 0 /* thread arg */);
 	if (result) {
 		kprintf("thread_fork failed: %s\n", strerror(result));
+		argblock_cleanup(ab);
+		kfree(ab);
 		proc_destroy(proc);
 		return result;
 	}
 
+#if OPT_WAITPID
+	/*
+	 * The new process is a child of the kernel process, so it
+	 * stays around as a zombie until we collect it here.
+	 */
+	result = proc_waitchild(proc->p_pid, false, &proc);
+	if (result) {
+		return result;
+	}
+	proc_destroy(proc);
+#else
 	/*
-	 * The new process will be destroyed when the program exits...
-	 * once you write the code for handling that.
+	 * The new process has no parent, so it is destroyed when the
+	 * program exits (see proc_exit).
 	 */
+#endif
 
 	return 0;
 }
@@ -494,6 +525,82 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_coremapstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	coremap_printstats();
+
+	return 0;
+}
+
+#if !OPT_DUMBVM
+static
+int
+cmd_tlbstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vm_tlb_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_swapstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	swap_printstats();
+	pageout_printstats();
+	vmcache_printstats();
+
+	return 0;
+}
+#endif
+
+static
+int
+cmd_schedstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_lockstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lock_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_sysstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	syscall_printstats();
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -563,6 +670,7 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[ck1] Timer overhead test           ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -601,6 +709,14 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[cm] Physical memory stats          ",
+#if !OPT_DUMBVM
+	"[tlb] TLB stats                     ",
+	"[swapstats] Swap/paging/cache stats ",
+#endif
+	"[schedstat] Scheduler stats         ",
+	"[lockstat] Lock stats               ",
+	"[sysstat] System call stats         ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -652,6 +768,14 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "cm",         cmd_coremapstats },
+#if !OPT_DUMBVM
+	{ "tlb",        cmd_tlbstats },
+	{ "swapstats",  cmd_swapstats },
+#endif
+	{ "schedstat",  cmd_schedstats },
+	{ "lockstat",   cmd_lockstats },
+	{ "sysstat",    cmd_sysstats },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -668,6 +792,7 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "ck1",	ticktest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
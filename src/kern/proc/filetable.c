@@ -0,0 +1,95 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <openfile.h>
+#include <filetable.h>
+
+/*
+ * File descriptor tables. See filetable.h.
+ */
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	unsigned i;
+
+	ft = kmalloc(sizeof(struct filetable));
+	if (ft == NULL) {
+		return NULL;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		ft->ft_files[i] = NULL;
+	}
+	return ft;
+}
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	unsigned i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_decref(ft->ft_files[i]);
+			ft->ft_files[i] = NULL;
+		}
+	}
+	kfree(ft);
+}
+
+int
+filetable_copy(struct filetable *src, struct filetable **ret)
+{
+	struct filetable *ft;
+	unsigned i;
+
+	ft = filetable_create();
+	if (ft == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		if (src->ft_files[i] != NULL) {
+			openfile_incref(src->ft_files[i]);
+			ft->ft_files[i] = src->ft_files[i];
+		}
+	}
+	*ret = ft;
+	return 0;
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX || ft->ft_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = ft->ft_files[fd];
+	return 0;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *fd)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] == NULL) {
+			ft->ft_files[i] = of;
+			*fd = i;
+			return 0;
+		}
+	}
+	return EMFILE;
+}
+
+int
+filetable_remove(struct filetable *ft, int fd, struct openfile **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX || ft->ft_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = ft->ft_files[fd];
+	ft->ft_files[fd] = NULL;
+	return 0;
+}
@@ -43,24 +43,127 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/time.h>	/* for kern/resource.h */
+#include <kern/resource.h>
 #include <spl.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
 
 #if OPT_WAITPID
+#include <limits.h>
 #include <synch.h>
 
 // ---------------------------------------------------------------------------------------------------------
 
-#define MAX_PROC 100
-static struct _processTable {								// PROCESS TABLE
-  int active;           /* initial value 0 */
-  struct proc *proc[MAX_PROC+1]; /* [0] not used. pids are >= 1 */
-  int last_i;           /* index of last allocated pid */
-  struct spinlock lk;	/* Lock for this table */
-} processTable;
+/*
+ * Process table, indexed directly by pid. It starts small and doubles
+ * whenever it runs out of free pids, up to PID_MAX. The free pids are
+ * kept on a FIFO list threaded through the free slots, so allocating
+ * and freeing one are O(1), and a pid is not handed out again until
+ * all the other free ones have been.
+ *
+ * pt_lock also protects the parent/child links in struct proc. It is
+ * a sleep lock because growing the table calls kmalloc.
+ *
+ * The kernel process is not registered in the table and has pid 0.
+ */
+#define PIDTABLE_INITSIZE 32
+
+struct pidslot {
+	struct proc *ps_proc;		/* process with this pid, or NULL */
+	pid_t ps_nextfree;		/* next on the free list, if free */
+};
+
+static struct {
+	struct pidslot *pt_slots;	/* indexed by pid */
+	unsigned pt_size;		/* number of slots */
+	pid_t pt_freehead;		/* first free pid, or 0 if none */
+	pid_t pt_freetail;		/* last free pid */
+	struct lock *pt_lock;
+} pidtable;
+
+static
+void
+pidtable_putfree(pid_t pid)
+{
+	pidtable.pt_slots[pid].ps_proc = NULL;
+	pidtable.pt_slots[pid].ps_nextfree = 0;
+	if (pidtable.pt_freetail == 0) {
+		pidtable.pt_freehead = pid;
+	}
+	else {
+		pidtable.pt_slots[pidtable.pt_freetail].ps_nextfree = pid;
+	}
+	pidtable.pt_freetail = pid;
+}
+
+/*
+ * Make the table bigger and put the new pids on the free list.
+ */
+static
+int
+pidtable_grow(void)
+{
+	struct pidslot *newslots;
+	unsigned newsize, i;
+
+	KASSERT(pidtable.pt_size == 0 || lock_do_i_hold(pidtable.pt_lock));
+
+	if (pidtable.pt_size > PID_MAX) {
+		return ENPROC;
+	}
+	if (pidtable.pt_size == 0) {
+		newsize = PIDTABLE_INITSIZE;
+	}
+	else if (pidtable.pt_size * 2 > PID_MAX + 1) {
+		newsize = PID_MAX + 1;
+	}
+	else {
+		newsize = pidtable.pt_size * 2;
+	}
+
+	newslots = kmalloc(newsize * sizeof(struct pidslot));
+	if (newslots == NULL) {
+		return ENOMEM;
+	}
+	if (pidtable.pt_slots != NULL) {
+		memcpy(newslots, pidtable.pt_slots,
+		       pidtable.pt_size * sizeof(struct pidslot));
+		kfree(pidtable.pt_slots);
+	}
+	pidtable.pt_slots = newslots;
+
+	for (i = pidtable.pt_size; i < newsize; i++) {
+		if (i < PID_MIN) {
+			newslots[i].ps_proc = NULL;
+			newslots[i].ps_nextfree = 0;
+		}
+		else {
+			pidtable_putfree(i);
+		}
+	}
+	pidtable.pt_size = newsize;
+	return 0;
+}
+
+static
+void
+pidtable_bootstrap(void)
+{
+	pidtable.pt_lock = lock_create("pidtable");
+	if (pidtable.pt_lock == NULL) {
+		panic("proc: lock_create for pidtable failed\n");
+	}
+	if (pidtable_grow()) {
+		panic("proc: cannot allocate pid table\n");
+	}
+}
 
 #endif
 /*
@@ -71,59 +174,90 @@ struct proc *kproc;
 // ---------------------------------------------------------------------------------------------------------
 
 /*
- * G.Cabodi - 2019
- * Initialize support for pid/waitpid.
+ * Look up a process by pid. Returns NULL if there is none.
  */
 struct proc *
-proc_search_pid(pid_t pid) {								// (X.) Trova processo nella tabella tramite PID -> restituisce puntatore
+proc_search_pid(pid_t pid)
+{
 #if OPT_WAITPID
-  struct proc *p;
-  KASSERT(pid>=0&&pid<MAX_PROC);								// verifica che il pid di input sia nell'intervallo di validità
-  p = processTable.proc[pid];									// ottiene il processo corrispondente al pid di input dalla tabella
-  KASSERT(p->p_pid==pid);
-  return p;														// restituisce il puntatore al processo trovato
+	struct proc *p;
+
+	lock_acquire(pidtable.pt_lock);
+	if (pid < PID_MIN || (unsigned)pid >= pidtable.pt_size) {
+		p = NULL;
+	}
+	else {
+		p = pidtable.pt_slots[pid].ps_proc;
+	}
+	lock_release(pidtable.pt_lock);
+	KASSERT(p == NULL || p->p_pid == pid);
+	return p;
 #else
-  (void)pid;
-  return NULL;
+	(void)pid;
+	return NULL;
 #endif
 }
 
+#if OPT_WAITPID
+/*
+ * Give PROC a pid and make it a child of PARENT, or of nobody if
+ * PARENT is NULL.
+ */
+static
+int
+proc_register(struct proc *proc, struct proc *parent)
+{
+	pid_t pid;
+	int result;
+
+	KASSERT(proc->p_pid == 0);
+
+	lock_acquire(pidtable.pt_lock);
+	if (pidtable.pt_freehead == 0) {
+		result = pidtable_grow();
+		if (result) {
+			lock_release(pidtable.pt_lock);
+			return result;
+		}
+	}
+	pid = pidtable.pt_freehead;
+	pidtable.pt_freehead = pidtable.pt_slots[pid].ps_nextfree;
+	if (pidtable.pt_freehead == 0) {
+		pidtable.pt_freetail = 0;
+	}
+	pidtable.pt_slots[pid].ps_proc = proc;
+	proc->p_pid = pid;
+
+	proc->p_parent = parent;
+	if (parent != NULL) {
+		proc->p_sibling = parent->p_children;
+		parent->p_children = proc;
+	}
+	lock_release(pidtable.pt_lock);
+	return 0;
+}
+#endif
+
 // ---------------------------------------------------------------------------------------------------------
 
-static void
-proc_init_waitpid(struct proc *proc, const char *name) {	// 3. Assegna PID in tabella e crea strumenti di sincronizzazione
+static int
+proc_init_waitpid(struct proc *proc, const char *name) {	// 3. Crea strumenti di sincronizzazione (il PID arriva con proc_register)
 #if OPT_WAITPID
-  /* search a free index in table using a circular strategy */
-  int i;
-  spinlock_acquire(&processTable.lk);							// acquisisce lock sulla tabella dei processi
-  i = processTable.last_i+1;									// parte da posizione successiva a ultimo PID
-  proc->p_pid = 0;												// inizializza il pid a 0
-  if (i>MAX_PROC) i=1;											// strategia circolare: se arriva alla fine, ricomincia
-  while (i!=processTable.last_i) {
-    if (processTable.proc[i] == NULL) {							// non appena trova un buco
-      processTable.proc[i] = proc;									// inserisce il processo nello slot
-      processTable.last_i = i;										// setta che l'ultimo pid inserito è i
-      proc->p_pid = i;												// ed assegna questo pid al processo
-      break;
-    }
-    i++;
-    if (i>MAX_PROC) i=1;
+  proc->p_pid = 0;
+  proc->p_parent = NULL;
+  proc->p_children = NULL;
+  proc->p_sibling = NULL;
+  proc->p_status = 0;											// status iniziale = 0 (ok)
+  proc->p_exited = false;
+  proc->p_waitcv = cv_create(name);								// coda su cui il processo aspetta i figli
+  if (proc->p_waitcv == NULL) {
+    return ENOMEM;
   }
-  spinlock_release(&processTable.lk);							// rilascia il lock
-  if (proc->p_pid==0) {
-    panic("too many processes. proc table is full\n");			// se pid è rimasto 0 => panic
-  }
-  proc->p_status = 0;											// se tutto ok (quindi non è stato lanciato panic) assegna status = 0 (ok)
-#if USE_SEMAPHORE_FOR_WAITPID
-  proc->p_sem = sem_create(name, 0);							// se uso semaforo, lo creo
-#else
-  proc->p_cv = cv_create(name);									// se uso condvar, la creo + creo lock da utilizzare
-  proc->p_lock = lock_create(name);
-#endif
 #else
   (void)proc;
   (void)name;
 #endif
+  return 0;
 }
 
 // ---------------------------------------------------------------------------------------------------------
@@ -131,20 +265,28 @@ proc_init_waitpid(struct proc *proc, const char *name) {	// 3. Assegna PID in ta
 static void
 proc_end_waitpid(struct proc *proc) {						// 6. Rimuove da tabella e distrugge sincronizzazione
 #if OPT_WAITPID
-  /* remove the process from the table */
-  int i;
-  spinlock_acquire(&processTable.lk);								// acquisisce lock sulla tabella dei processi
-  i = proc->p_pid;												// ottiene il PID del processo da rimuovere
-  KASSERT(i>0 && i<=MAX_PROC);									// verifica che il PID sia nell'intervallo di validità
-  processTable.proc[i] = NULL;									// rimuove il processo dalla tabella
-  spinlock_release(&processTable.lk);								// rilascia il lock sulla tabella dei processi
-
-#if USE_SEMAPHORE_FOR_WAITPID
-  sem_destroy(proc->p_sem);										// distrugge il semaforo del processo
-#else
-  cv_destroy(proc->p_cv);										// distrugge il condvar del processo + distrugge il lock usato col condvar
-  lock_destroy(proc->p_lock);	
-#endif
+  struct proc **pp, *child;
+
+  if (proc->p_pid != 0) {
+    lock_acquire(pidtable.pt_lock);
+    KASSERT(pidtable.pt_slots[proc->p_pid].ps_proc == proc);
+    pidtable_putfree(proc->p_pid);								// libera il pid
+    /* unlink from the parent's list of children */
+    if (proc->p_parent != NULL) {
+      for (pp = &proc->p_parent->p_children; *pp != proc; pp = &(*pp)->p_sibling) {
+        KASSERT(*pp != NULL);
+      }
+      *pp = proc->p_sibling;
+    }
+    /* our children lose their parent */
+    for (child = proc->p_children; child != NULL; child = child->p_sibling) {
+      child->p_parent = NULL;
+    }
+    proc->p_children = NULL;
+    lock_release(pidtable.pt_lock);
+  }
+
+  cv_destroy(proc->p_waitcv);									// distrugge la coda di attesa dei figli
 #else
   (void)proc;
 #endif
@@ -173,14 +315,22 @@ proc_create(const char *name)								// 2. Alloca memoria e inizializza struttur
 																// inizializza tutto il necessario:
 	proc->p_numthreads = 0;											// num threads
 	spinlock_init(&proc->p_lock);									// spinlock
+	proc->p_nice = 0;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;										// address space
 
 	/* VFS fields */
 	proc->p_cwd = NULL;												// directory corrente
+#if OPT_SYSCALLS
+	proc->p_filetable = NULL;
+#endif
 
-	proc_init_waitpid(proc,name);									// (3) avvia supporto per waitpid (assegna PID e crea strumenti per sincronizzazione)
+	if (proc_init_waitpid(proc,name)) {							// (3) avvia supporto per waitpid (crea strumenti per sincronizzazione)
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
 
 	return proc;												// restituisce il puntatore al nuovo processo
 }
@@ -214,6 +364,12 @@ proc_destroy(struct proc *proc)								// 5. Cleanup completo del processo
 	 */
 
 	/* VFS fields */
+#if OPT_SYSCALLS
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
+#endif
 	if (proc->p_cwd) {											// verifica se il processo ha una directory corrente
 		VOP_DECREF(proc->p_cwd);									// usa il puntatore per arrivare alla struttura e decrementare il riferimento alla directory
 		proc->p_cwd = NULL;											// imposta la directory corrente a NULL, quindi il puntatore non punta più a niente
@@ -282,24 +438,56 @@ proc_destroy(struct proc *proc)								// 5. Cleanup completo del processo
 void
 proc_bootstrap(void)										// Crea la struttura proc del kernel
 {
+#if OPT_WAITPID
+	pidtable_bootstrap();
+#endif
 	kproc = proc_create("[kernel]");
 	if (kproc == NULL) {
 		panic("proc_create for kproc failed\n");
 	}
-#if OPT_WAITPID
-	spinlock_init(&processTable.lk);
-	/* kernel process is not registered in the table */
-	processTable.active = 1;
-#endif
 }
 
 // ---------------------------------------------------------------------------------------------------------
 
+#if OPT_SYSCALLS
+/*
+ * Open the console as descriptors 0, 1 and 2 (stdin, stdout and
+ * stderr) of the empty file table FT.
+ */
+static
+int
+proc_openconsole(struct filetable *ft)
+{
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct openfile *of;
+	char path[5];
+	int fd, i, result;
+
+	for (i=0; i<3; i++) {
+		/* vfs_open may scribble on the path */
+		strcpy(path, "con:");
+		result = openfile_open(path, modes[i], 0, &of);
+		if (result) {
+			return result;
+		}
+		result = filetable_place(ft, of, &fd);
+		if (result) {
+			openfile_decref(of);
+			return result;
+		}
+		KASSERT(fd == i);
+	}
+	return 0;
+}
+#endif
+
 /*
  * Create a fresh proc for use by runprogram.
  *
  * It will have no address space and will inherit the current
- * process's (that is, the kernel menu's) current directory.
+ * process's (that is, the kernel menu's) current directory. Its
+ * standard input, output and error are the console. It is a child of
+ * the current process, which collects it with proc_waitchild.
  */
 struct proc *
 proc_create_runprogram(const char *name)					// 1. Creazione del processo e eredita directory dal padre -> restituisce il puntatore al nuovo processo
@@ -329,9 +517,80 @@ proc_create_runprogram(const char *name)					// 1. Creazione del processo e ered
 	}
 	spinlock_release(&curproc->p_lock);
 
+#if OPT_WAITPID
+	if (proc_register(newproc, curproc)) {
+		proc_destroy(newproc);
+		return NULL;
+	}
+#endif
+
+#if OPT_SYSCALLS
+	newproc->p_filetable = filetable_create();
+	if (newproc->p_filetable == NULL ||
+	    proc_openconsole(newproc->p_filetable)) {
+		proc_destroy(newproc);
+		return NULL;
+	}
+#endif
+
 	return newproc;												// restituisce il puntatore al nuovo processo
 }
 
+
+#if OPT_SYSCALLS
+/*
+ * Create a copy of the current process for fork: same name, current
+ * directory and open files, and a copy of its address space. The new
+ * process has no threads yet.
+ */
+int
+proc_fork(struct proc **ret)
+{
+	struct proc *newproc;
+	struct addrspace *as;
+	int result;
+
+	newproc = proc_create(curproc->p_name);
+	if (newproc == NULL) {
+		return ENOMEM;
+	}
+
+	as = proc_getas();
+	if (as != NULL) {
+		result = as_copy(as, &newproc->p_addrspace);
+		if (result) {
+			proc_destroy(newproc);
+			return result;
+		}
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	if (curproc->p_cwd != NULL) {
+		VOP_INCREF(curproc->p_cwd);
+		newproc->p_cwd = curproc->p_cwd;
+	}
+	newproc->p_nice = curproc->p_nice;
+	spinlock_release(&curproc->p_lock);
+
+	result = filetable_copy(curproc->p_filetable, &newproc->p_filetable);
+	if (result) {
+		proc_destroy(newproc);
+		return result;
+	}
+
+#if OPT_WAITPID
+	result = proc_register(newproc, curproc);
+	if (result) {
+		proc_destroy(newproc);
+		return result;
+	}
+#endif
+
+	*ret = newproc;
+	return 0;
+}
+#endif
+
 // ---------------------------------------------------------------------------------------------------------
 
 /*
@@ -432,33 +691,208 @@ proc_setas(struct addrspace *newas)
 	return oldas;
 }
 
-
 // ---------------------------------------------------------------------------------------------------------
 
-int 
-proc_wait(struct proc *proc)									// 4. Attende terminazione -> restituisce status
+/*
+ * Release the parts of the current process a zombie does not need:
+ * its open files, address space and current directory.
+ */
+static
+void
+proc_release(struct proc *proc)
 {
+	struct addrspace *as;
+	struct vnode *cwd;
+
+	KASSERT(proc == curproc);
+
+#if OPT_SYSCALLS
+	if (proc->p_filetable != NULL) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
+#endif
+
+	/* As in proc_destroy: clear, then deactivate, then destroy. */
+	as = proc_setas(NULL);
+	as_deactivate();
+	if (as != NULL) {
+		as_destroy(as);
+	}
+
+	/* VOP_DECREF may sleep, so not under the spinlock. */
+	spinlock_acquire(&proc->p_lock);
+	cwd = proc->p_cwd;
+	proc->p_cwd = NULL;
+	spinlock_release(&proc->p_lock);
+	if (cwd != NULL) {
+		VOP_DECREF(cwd);
+	}
+}
+
+void
+proc_exit(int status)
+{
+	struct proc *proc = curproc;
 #if OPT_WAITPID
-        int return_status;
-        /* NULL and kernel proc forbidden */
-	KASSERT(proc != NULL);
-	KASSERT(proc != kproc);
+	struct proc *child, *next, *zombies;
+	bool orphan;
+#endif
+
+	KASSERT(proc != NULL && proc != kproc);
+
+	proc_release(proc);
+
+	/*
+	 * Detach the thread before telling the parent, so that by the
+	 * time it can see we have exited there are no threads left.
+	 */
+	proc_remthread(curthread);
+
+#if OPT_WAITPID
+	lock_acquire(pidtable.pt_lock);
+
+	proc->p_status = status;
+	proc->p_exited = true;
+
+	/*
+	 * Our children are orphaned: the live ones will reap themselves
+	 * when they exit, and the zombies nobody would ever collect are
+	 * reaped now.
+	 */
+	zombies = NULL;
+	for (child = proc->p_children; child != NULL; child = next) {
+		next = child->p_sibling;
+		child->p_parent = NULL;
+		if (child->p_exited) {
+			child->p_sibling = zombies;
+			zombies = child;
+		}
+		else {
+			child->p_sibling = NULL;
+		}
+	}
+	proc->p_children = NULL;
 
-        /* wait on semaphore or condition variable */ 
-#if USE_SEMAPHORE_FOR_WAITPID
-        P(proc->p_sem);												// attesa sul semaforo che processo figlio termini, segnalato con sys__exit
+	orphan = proc->p_parent == NULL;
+	if (!orphan) {
+		cv_broadcast(proc->p_parent->p_waitcv, pidtable.pt_lock);
+	}
+	lock_release(pidtable.pt_lock);
+
+	while (zombies != NULL) {
+		child = zombies;
+		zombies = child->p_sibling;
+		child->p_sibling = NULL;
+		proc_destroy(child);
+	}
+	if (orphan) {
+		proc_destroy(proc);
+	}
 #else
-        lock_acquire(proc->p_lock);
-        cv_wait(proc->p_cv);										// attesa sul condvar che processo figlio termini, segnalato con sys__exit
-        lock_release(proc->p_lock);
+	(void)status;
+	proc_destroy(proc);
 #endif
-        return_status = proc->p_status;								// copia lo status di uscita dal processo terminato
-        proc_destroy(proc);											// distrugge la struttura del processo (cleanup)
-        return return_status;										// restituisce lo status di uscita
-#else
-        /* this doesn't synchronize */ 
-        (void)proc;
-        return 0;
+}
+
+#if OPT_WAITPID
+int
+proc_waitchild(pid_t pid, bool nohang, struct proc **ret)
+{
+	struct proc *child;
+
+	lock_acquire(pidtable.pt_lock);
+
+	if (pid < PID_MIN || (unsigned)pid >= pidtable.pt_size ||
+	    pidtable.pt_slots[pid].ps_proc == NULL) {
+		lock_release(pidtable.pt_lock);
+		return ESRCH;
+	}
+	child = pidtable.pt_slots[pid].ps_proc;
+	if (child->p_parent != curproc) {
+		lock_release(pidtable.pt_lock);
+		return ECHILD;
+	}
+
+	while (!child->p_exited) {
+		if (nohang) {
+			child = NULL;
+			break;
+		}
+		cv_wait(curproc->p_waitcv, pidtable.pt_lock);
+	}
+	lock_release(pidtable.pt_lock);
+
+	/*
+	 * Only we can collect the zombie, so it stays put until we
+	 * destroy it.
+	 */
+	*ret = child;
+	return 0;
+}
 #endif
+
+#if OPT_WAITPID
+/*
+ * Find the live process PID (0 for the current one) for proc_setnice
+ * and proc_getnice. Call with the pid table locked.
+ */
+static
+struct proc *
+proc_findlive(pid_t pid)
+{
+	struct proc *p;
+
+	KASSERT(lock_do_i_hold(pidtable.pt_lock));
+
+	if (pid == 0) {
+		return curproc;
+	}
+	if (pid < PID_MIN || (unsigned)pid >= pidtable.pt_size) {
+		return NULL;
+	}
+	p = pidtable.pt_slots[pid].ps_proc;
+	if (p == NULL || p->p_exited) {
+		return NULL;
+	}
+	return p;
 }
 
+int
+proc_setnice(pid_t pid, int nice)
+{
+	struct proc *p;
+
+	KASSERT(nice >= PRIO_MIN && nice <= PRIO_MAX);
+
+	lock_acquire(pidtable.pt_lock);
+	p = proc_findlive(pid);
+	if (p == NULL) {
+		lock_release(pidtable.pt_lock);
+		return ESRCH;
+	}
+	spinlock_acquire(&p->p_lock);
+	p->p_nice = nice;
+	spinlock_release(&p->p_lock);
+	lock_release(pidtable.pt_lock);
+	return 0;
+}
+
+int
+proc_getnice(pid_t pid, int *ret)
+{
+	struct proc *p;
+
+	lock_acquire(pidtable.pt_lock);
+	p = proc_findlive(pid);
+	if (p == NULL) {
+		lock_release(pidtable.pt_lock);
+		return ESRCH;
+	}
+	spinlock_acquire(&p->p_lock);
+	*ret = p->p_nice;
+	spinlock_release(&p->p_lock);
+	lock_release(pidtable.pt_lock);
+	return 0;
+}
+#endif
@@ -0,0 +1,208 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <argblock.h>
+
+/*
+ * Argument blocks. See argblock.h.
+ */
+
+/* Pointer slot I of the block, holding an offset until it is placed. */
+#define AB_SLOT(ab, i) (((vaddr_t *)(ab)->ab_buf)[i])
+
+static
+int
+argblock_init(struct argblock *ab)
+{
+	ab->ab_buf = kmalloc(PAGE_SIZE);
+	if (ab->ab_buf == NULL) {
+		return ENOMEM;
+	}
+	ab->ab_size = PAGE_SIZE;
+	ab->ab_len = 0;
+	ab->ab_argc = 0;
+	return 0;
+}
+
+/*
+ * Double the buffer, up to ARG_MAX.
+ */
+static
+int
+argblock_grow(struct argblock *ab)
+{
+	char *newbuf;
+	size_t newsize;
+
+	if (ab->ab_size >= ARG_MAX) {
+		return E2BIG;
+	}
+	newsize = ab->ab_size * 2 < ARG_MAX ? ab->ab_size * 2 : ARG_MAX;
+	newbuf = kmalloc(newsize);
+	if (newbuf == NULL) {
+		return ENOMEM;
+	}
+	memcpy(newbuf, ab->ab_buf, ab->ab_len);
+	kfree(ab->ab_buf);
+	ab->ab_buf = newbuf;
+	ab->ab_size = newsize;
+	return 0;
+}
+
+/*
+ * Make room for the pointer array once the argument count is known.
+ */
+static
+int
+argblock_setargc(struct argblock *ab, int argc)
+{
+	int result;
+
+	if ((size_t)(argc + 1) * sizeof(vaddr_t) > ARG_MAX) {
+		return E2BIG;
+	}
+	ab->ab_argc = argc;
+	ab->ab_len = (argc + 1) * sizeof(vaddr_t);
+	while (ab->ab_len > ab->ab_size) {
+		result = argblock_grow(ab);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+int
+argblock_copyin(struct argblock *ab, userptr_t uargv)
+{
+	userptr_t uarg;
+	size_t got;
+	int argc, i, result;
+
+	result = argblock_init(ab);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * First the pointers, straight into the slots where the string
+	 * offsets will go, which also tells us how many there are.
+	 */
+	for (argc = 0; ; argc++) {
+		if ((argc + 1) * sizeof(vaddr_t) > ab->ab_size) {
+			ab->ab_len = argc * sizeof(vaddr_t);
+			result = argblock_grow(ab);
+			if (result) {
+				goto fail;
+			}
+		}
+		result = copyin((const_userptr_t)((vaddr_t)uargv +
+						  argc * sizeof(userptr_t)),
+				&uarg, sizeof(uarg));
+		if (result) {
+			goto fail;
+		}
+		if (uarg == NULL) {
+			break;
+		}
+		AB_SLOT(ab, argc) = (vaddr_t)uarg;
+	}
+	result = argblock_setargc(ab, argc);
+	if (result) {
+		goto fail;
+	}
+
+	/* Then the strings, each right after the last. */
+	for (i = 0; i < argc; i++) {
+		uarg = (userptr_t)AB_SLOT(ab, i);
+		while (1) {
+			result = copyinstr(uarg, ab->ab_buf + ab->ab_len,
+					   ab->ab_size - ab->ab_len, &got);
+			if (result != ENAMETOOLONG) {
+				break;
+			}
+			result = argblock_grow(ab);
+			if (result) {
+				goto fail;
+			}
+		}
+		if (result) {
+			goto fail;
+		}
+		AB_SLOT(ab, i) = ab->ab_len;
+		ab->ab_len += got;
+	}
+	return 0;
+
+ fail:
+	argblock_cleanup(ab);
+	return result;
+}
+
+int
+argblock_kinit(struct argblock *ab, int argc, char **args)
+{
+	size_t len;
+	int i, result;
+
+	result = argblock_init(ab);
+	if (result) {
+		return result;
+	}
+	result = argblock_setargc(ab, argc);
+	if (result) {
+		argblock_cleanup(ab);
+		return result;
+	}
+
+	for (i = 0; i < argc; i++) {
+		len = strlen(args[i]) + 1;
+		while (ab->ab_len + len > ab->ab_size) {
+			result = argblock_grow(ab);
+			if (result) {
+				argblock_cleanup(ab);
+				return result;
+			}
+		}
+		memcpy(ab->ab_buf + ab->ab_len, args[i], len);
+		AB_SLOT(ab, i) = ab->ab_len;
+		ab->ab_len += len;
+	}
+	return 0;
+}
+
+const char *
+argblock_arg(struct argblock *ab, int i)
+{
+	KASSERT(i >= 0 && i < ab->ab_argc);
+	return ab->ab_buf + AB_SLOT(ab, i);
+}
+
+int
+argblock_copyout(struct argblock *ab, vaddr_t *stackptr, userptr_t *uargv)
+{
+	vaddr_t base;
+	int i;
+
+	/* The stack pointer must stay 8-aligned. */
+	base = (*stackptr - ab->ab_len) & ~(vaddr_t)7;
+
+	for (i = 0; i < ab->ab_argc; i++) {
+		AB_SLOT(ab, i) += base;
+	}
+	AB_SLOT(ab, ab->ab_argc) = 0;
+
+	*stackptr = base;
+	*uargv = (userptr_t)base;
+	return copyout(ab->ab_buf, (userptr_t)base, ab->ab_len);
+}
+
+void
+argblock_cleanup(struct argblock *ab)
+{
+	kfree(ab->ab_buf);
+	ab->ab_buf = NULL;
+}
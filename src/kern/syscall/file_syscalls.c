@@ -1,6 +1,10 @@
 #include <types.h>
 #include <kern/unistd.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
+#include <limits.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -11,95 +15,387 @@
 #include <mips/trapframe.h>
 #include <current.h>
 #include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <pipe.h>
 
-int sys_write(int fd, userptr_t buf_ptr, size_t size){
-    int i;
-    char *p = (char *)buf_ptr;
+/*
+ * File system calls. Descriptors index the process's file table
+ * (filetable.h), which points to shared open files (openfile.h).
+ */
 
-    if(fd!=STDOUT_FILENO && fd!=STDERR_FILENO){
-        kprintf("sys_write supported only to sdtdout\n");
-        return -1;
-    }
+/* Longest transfer whose length fits in a return value. */
+#define FILE_MAXIO	0x7fffffff
 
-    for(i=0; i<(int)size; i++){
-        putch(p[i]);
-    }
+/*
+ * Set up U to move LEN bytes between the NIOV user buffers in IOV and
+ * a file at offset POS.
+ */
+static
+void
+file_uinit(struct uio *u, struct iovec *iov, unsigned niov, size_t len,
+	   off_t pos, enum uio_rw rw)
+{
+	u->uio_iov = iov;
+	u->uio_iovcnt = niov;
+	u->uio_offset = pos;
+	u->uio_resid = len;
+	u->uio_segflg = UIO_USERSPACE;
+	u->uio_rw = rw;
+	u->uio_space = proc_getas();
+}
+
+/*
+ * Common code for all reads and writes: move LEN bytes between the
+ * NIOV user buffers in IOV and the file open on FD. Normally the I/O
+ * happens at the file's position (or at its end, for appending
+ * writes), which then moves past it. With AT set (pread and the like)
+ * it happens at POS instead, and the position is neither used nor
+ * changed, so the openfile does not have to be locked. The number of
+ * bytes moved is handed back in DONE. If the file system fails after
+ * moving some bytes, those are reported and the error is dropped, as
+ * for any short read or write; the error is returned only if nothing
+ * was moved.
+ */
+static
+int
+file_io(int fd, struct iovec *iov, unsigned niov, size_t len,
+	bool at, off_t pos, enum uio_rw rw, size_t *done)
+{
+	struct openfile *of;
+	struct uio u;
+	struct stat st;
+	bool locked;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	if (of->of_accmode == (rw == UIO_READ ? O_WRONLY : O_RDONLY)) {
+		return EBADF;
+	}
+	if (at && !of->of_seekable) {
+		return ESPIPE;
+	}
+	if (at && pos < 0) {
+		return EINVAL;
+	}
+
+	locked = !at && of->of_seekable;
+	if (locked) {
+		lock_acquire(of->of_lock);
+		pos = of->of_offset;
+	}
+
+	result = 0;
+	if (locked && rw == UIO_WRITE && of->of_append) {
+		result = VOP_STAT(of->of_vnode, &st);
+		pos = st.st_size;
+	}
+	if (result == 0) {
+		file_uinit(&u, iov, niov, len, pos, rw);
+		if (rw == UIO_READ) {
+			result = VOP_READ(of->of_vnode, &u);
+		}
+		else {
+			result = VOP_WRITE(of->of_vnode, &u);
+		}
+		if (locked) {
+			of->of_offset = u.uio_offset;
+		}
+		*done = len - u.uio_resid;
+		if (*done > 0) {
+			result = 0;
+		}
+	}
+
+	if (locked) {
+		lock_release(of->of_lock);
+	}
+	return result;
+}
+
+/*
+ * read, write, pread and pwrite: one buffer.
+ */
+static
+int
+file_buf(int fd, userptr_t buf, size_t len, bool at, off_t pos,
+	 enum uio_rw rw, int32_t *retval)
+{
+	struct iovec iov;
+	size_t done;
+	int result;
+
+	if (len > FILE_MAXIO) {
+		len = FILE_MAXIO;
+	}
+	iov.iov_ubase = buf;
+	iov.iov_len = len;
+	result = file_io(fd, &iov, 1, len, at, pos, rw, &done);
+	if (result) {
+		return result;
+	}
+	*retval = done;
+	return 0;
+}
 
-    return (int)size;
+/*
+ * readv, writev, preadv and pwritev: IOVCNT buffers described by the
+ * user's iovec array UIOV, handled by the file system in one uio.
+ */
+static
+int
+file_vec(int fd, const_userptr_t uiov, int iovcnt, bool at, off_t pos,
+	 enum uio_rw rw, int32_t *retval)
+{
+	struct iovec *iov;
+	size_t len, done;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+	iov = kmalloc(iovcnt * sizeof(struct iovec));
+	if (iov == NULL) {
+		return ENOMEM;
+	}
+	result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+	if (result) {
+		kfree(iov);
+		return result;
+	}
+
+	len = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > FILE_MAXIO - len) {
+			kfree(iov);
+			return EINVAL;
+		}
+		len += iov[i].iov_len;
+	}
+
+	result = file_io(fd, iov, iovcnt, len, at, pos, rw, &done);
+	kfree(iov);
+	if (result) {
+		return result;
+	}
+	*retval = done;
+	return 0;
 }
 
-// --------------------------------------------------
+int
+sys_read(int fd, userptr_t buf, size_t len, int32_t *retval)
+{
+	return file_buf(fd, buf, len, false, 0, UIO_READ, retval);
+}
 
-int sys_read(int fd, userptr_t buf_ptr, size_t size){
-    int i;
-    char *p = (char *)buf_ptr;
+int
+sys_write(int fd, userptr_t buf, size_t len, int32_t *retval)
+{
+	return file_buf(fd, buf, len, false, 0, UIO_WRITE, retval);
+}
+
+int
+sys_pread(int fd, userptr_t buf, size_t len, off_t pos, int32_t *retval)
+{
+	return file_buf(fd, buf, len, true, pos, UIO_READ, retval);
+}
 
-    if(fd!=STDIN_FILENO){
-        kprintf("sys_read supported only to stdin\n");
-        return -1;
-    }
+int
+sys_pwrite(int fd, userptr_t buf, size_t len, off_t pos, int32_t *retval)
+{
+	return file_buf(fd, buf, len, true, pos, UIO_WRITE, retval);
+}
 
-    for(i=0; i<(int)size; i++){
-        p[i] = getch();
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int32_t *retval)
+{
+	return file_vec(fd, iov, iovcnt, false, 0, UIO_READ, retval);
+}
 
-        if(p[i] < 0){
-            return i;
-        }
-    }
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int32_t *retval)
+{
+	return file_vec(fd, iov, iovcnt, false, 0, UIO_WRITE, retval);
+}
 
-    return (int)size;
+int
+sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	   int32_t *retval)
+{
+	return file_vec(fd, iov, iovcnt, true, pos, UIO_READ, retval);
 }
 
-// --------------------------------------------------
+int
+sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	    int32_t *retval)
+{
+	return file_vec(fd, iov, iovcnt, true, pos, UIO_WRITE, retval);
+}
 
-void sys__exit(int status){
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int32_t *retval)
+{
+	struct openfile *of;
+	char *path;
+	int fd, result;
 
-#if OPT_WAITPID
+	path = kmalloc(PATH_MAX);
+	if (path == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(upath, path, PATH_MAX, NULL);
+	if (result) {
+		kfree(path);
+		return result;
+	}
 
-    struct proc *p = curproc;
-    p->p_status = status & 0xff;                        // salva solo i primi 8 bit dello status (perchè in UNIX l'exit status deve essere di 8 bit)
-    proc_remthread(curthread);                          // decrementa il numero di thread del processo corrente (numthread)
+	result = openfile_open(path, flags, mode, &of);
+	kfree(path);
+	if (result) {
+		return result;
+	}
 
-    #if USE_SEMAPHORE_FOR_WAITPID
-        V(p->p_sem);                                    // risveglia eventuali processi in attesa sul semaforo
-    #else
-        lock_acquire(p->p_lock);
-        cv_signal(p->p_cv);                             // risveglia eventuali processi in attesa sul condvar
-        lock_release(p->p_lock);
-    #endif
+	result = filetable_place(curproc->p_filetable, of, &fd);
+	if (result) {
+		openfile_decref(of);
+		return result;
+	}
+	*retval = fd;
+	return 0;
+}
 
+int
+sys_close(int fd)
+{
+	struct openfile *of;
+	int result;
 
-#else
-    struct addrspace *as = proc_getas();                // ottiene l'address space dal processo corrente
+	result = filetable_remove(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	openfile_decref(of);
+	return 0;
+}
 
-    as_destroy(as);                                     // distrugge l'address space, liberando memoria
+/*
+ * pipe: make a pipe and return descriptors for its read and write
+ * ends in FDS[0] and FDS[1].
+ */
+int
+sys_pipe(userptr_t ufds)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct vnode *rv, *wv;
+	struct openfile *rof, *wof, *junk;
+	int fds[2], result;
 
-#endif
+	result = pipe_create(&rv, &wv);
+	if (result) {
+		return result;
+	}
+	result = openfile_create(rv, O_RDONLY, &rof);
+	if (result) {
+		vfs_close(rv);
+		vfs_close(wv);
+		return result;
+	}
+	result = openfile_create(wv, O_WRONLY, &wof);
+	if (result) {
+		openfile_decref(rof);
+		vfs_close(wv);
+		return result;
+	}
 
-    thread_exit();                                      // termina il thread corrente
+	result = filetable_place(ft, rof, &fds[0]);
+	if (result) {
+		goto fail;
+	}
+	result = filetable_place(ft, wof, &fds[1]);
+	if (result) {
+		filetable_remove(ft, fds[0], &junk);
+		goto fail;
+	}
+	result = copyout(fds, ufds, sizeof(fds));
+	if (result) {
+		filetable_remove(ft, fds[0], &junk);
+		filetable_remove(ft, fds[1], &junk);
+		goto fail;
+	}
+	return 0;
 
-    panic("thread exit returned (should not happen)\n");
-    (void) status;
+ fail:
+	openfile_decref(rof);
+	openfile_decref(wof);
+	return result;
 }
 
-// -----------------------------------------------
+/*
+ * ioctl: pass CODE and the user pointer DATA on to the object FD is
+ * open on. What they mean is up to it; see <kern/ioctl.h>.
+ */
+int
+sys_ioctl(int fd, int code, userptr_t data)
+{
+	struct openfile *of;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	return VOP_IOCTL(of->of_vnode, code, data);
+}
 
 int
-sys_waitpid(pid_t pid, userptr_t statusp, int options)
+sys_lseek(int fd, off_t pos, int whence, off_t *retval)
 {
-#if OPT_WAITPID
-  struct proc *p = proc_search_pid(pid);                // (4) cerca il processo figlio con il PID specificato
-  int s;
-  (void)options; /* not handled */
-  if (p==NULL) return -1;                               // se non trova il provesso, ritorna errore
-  s = proc_wait(p);                                     // attende che il professo figlio termini e ottiene il suo exit status
-  if (statusp!=NULL) 
-    *(int*)statusp = s;                                 // se il puntatore statusp non è nullo, scrive lo status di uscita del figlio 
-  return pid;                                           // ritorna il PID del processo atteso
-#else
-  (void)options; /* not handled */
-  (void)pid;
-  (void)statusp;
-  return -1;
-#endif
-}
\ No newline at end of file
+	struct openfile *of;
+	struct stat st;
+	off_t newpos;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	if (!of->of_seekable) {
+		return ESPIPE;
+	}
+
+	lock_acquire(of->of_lock);
+	switch (whence) {
+	    case SEEK_SET:
+		newpos = pos;
+		break;
+	    case SEEK_CUR:
+		newpos = of->of_offset + pos;
+		break;
+	    case SEEK_END:
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			lock_release(of->of_lock);
+			return result;
+		}
+		newpos = st.st_size + pos;
+		break;
+	    default:
+		lock_release(of->of_lock);
+		return EINVAL;
+	}
+	if (newpos < 0) {
+		lock_release(of->of_lock);
+		return EINVAL;
+	}
+	of->of_offset = newpos;
+	lock_release(of->of_lock);
+
+	*retval = newpos;
+	return 0;
+}
@@ -60,6 +60,7 @@
 #include <vnode.h>
 #include <elf.h>
 
+#if OPT_DUMBVM
 /*
  * Load a segment at virtual address VADDR. The segment in memory
  * extends from VADDR up to (but not including) VADDR+MEMSIZE. The
@@ -144,6 +145,7 @@ load_segment(struct addrspace *as, struct vnode *v,
 
 	return result;
 }
+#endif /* OPT_DUMBVM */
 
 /*
  * Load an ELF executable user program into the current address space.
@@ -251,6 +253,23 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		if (result) {
 			return result;
 		}
+
+#if !OPT_DUMBVM
+		/*
+		 * Don't read anything now: the VM system pages the
+		 * segment in from the executable as it is touched.
+		 */
+		if (ph.p_filesz > ph.p_memsz) {
+			kprintf("ELF: warning: segment filesize > "
+				"segment memsize\n");
+			ph.p_filesz = ph.p_memsz;
+		}
+		result = as_define_filedata(as, ph.p_vaddr, ph.p_filesz,
+					    v, ph.p_offset);
+		if (result) {
+			return result;
+		}
+#endif
 	}
 
 	result = as_prepare_load(as);
@@ -258,6 +277,8 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
+#if OPT_DUMBVM
+
 	/*
 	 * Now actually load each segment.
 	 */
@@ -295,6 +316,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return result;
 		}
 	}
+#endif /* OPT_DUMBVM */
 
 	result = as_complete_load(as);
 	if (result) {
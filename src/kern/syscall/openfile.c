@@ -0,0 +1,99 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <openfile.h>
+
+/*
+ * Open file objects. See openfile.h.
+ */
+
+/*
+ * Make an openfile for V, whose reference it takes over.
+ */
+int
+openfile_create(struct vnode *v, int flags, struct openfile **ret)
+{
+	struct openfile *of;
+
+	of = kmalloc(sizeof(struct openfile));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	of->of_vnode = v;
+	of->of_accmode = flags & O_ACCMODE;
+	of->of_append = (flags & O_APPEND) != 0;
+	of->of_seekable = VOP_ISSEEKABLE(v);
+	of->of_offset = 0;
+	of->of_refcount = 1;
+	spinlock_init(&of->of_reflock);
+
+	*ret = of;
+	return 0;
+}
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct vnode *v;
+	int result;
+
+	switch (flags & O_ACCMODE) {
+	    case O_RDONLY:
+	    case O_WRONLY:
+	    case O_RDWR:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	result = vfs_open(path, flags, mode, &v);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_create(v, flags, ret);
+	if (result) {
+		vfs_close(v);
+		return result;
+	}
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	bool last;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	of->of_refcount--;
+	last = of->of_refcount == 0;
+	spinlock_release(&of->of_reflock);
+
+	if (!last) {
+		return;
+	}
+
+	vfs_close(of->of_vnode);
+	lock_destroy(of->of_lock);
+	spinlock_cleanup(&of->of_reflock);
+	kfree(of);
+}
@@ -0,0 +1,194 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/time.h>	/* for kern/resource.h */
+#include <kern/resource.h>
+#include <kern/wait.h>
+#include <limits.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <vfs.h>
+#include <argblock.h>
+#include <proc.h>
+#include <thread.h>
+#include <current.h>
+#include <syscall.h>
+
+/*
+ * Process-related system calls.
+ */
+
+/*
+ * execv: replace the current program with PROG, run with the
+ * arguments in the null-terminated array ARGV. The arguments are
+ * copied straight into a block laid out as on the new stack, which
+ * then goes out in one copyout; see argblock.h. Only returns on
+ * error, in which case the old program carries on.
+ */
+int
+sys_execv(userptr_t prog, userptr_t argv)
+{
+	struct argblock ab;
+	struct vnode *v;
+	char *path;
+	int result;
+
+	path = kmalloc(PATH_MAX);
+	if (path == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(prog, path, PATH_MAX, NULL);
+	if (result) {
+		kfree(path);
+		return result;
+	}
+
+	result = argblock_copyin(&ab, argv);
+	if (result) {
+		kfree(path);
+		return result;
+	}
+
+	result = vfs_open(path, O_RDONLY, 0, &v);
+	kfree(path);
+	if (result) {
+		argblock_cleanup(&ab);
+		return result;
+	}
+
+	result = exec_program(v, &ab);
+
+	/* Only get here on failure. */
+	argblock_cleanup(&ab);
+	return result;
+}
+
+#if OPT_WAITPID
+/*
+ * fork: duplicate the current process. The child gets a copy of the
+ * address space and of the descriptor table (sharing the open files,
+ * and thus their offsets, with the parent), and returns to user mode
+ * from the same trapframe with a return value of 0.
+ */
+int
+sys_fork(struct trapframe *tf, int32_t *retval)
+{
+	struct proc *newproc;
+	pid_t pid;
+	int result;
+
+	result = proc_fork(&newproc);
+	if (result) {
+		return result;
+	}
+	/* The child may run, exit and be reaped before we look again. */
+	pid = newproc->p_pid;
+
+	result = thread_fork_trapframe(curthread->t_name, newproc, tf);
+	if (result) {
+		proc_destroy(newproc);
+		return result;
+	}
+
+	*retval = pid;
+	return 0;
+}
+
+/*
+ * getpid: return the pid of the current process. Cannot fail.
+ */
+int
+sys_getpid(int32_t *retval)
+{
+	*retval = curproc->p_pid;
+	return 0;
+}
+
+/*
+ * waitpid: wait for the child PID to exit, store its status in
+ * *STATUSP if STATUSP is not null, and collect it. The only option
+ * is WNOHANG, which returns 0 instead of waiting. If the status
+ * cannot be stored the child is left for another try.
+ */
+int
+sys_waitpid(pid_t pid, userptr_t statusp, int options, int32_t *retval)
+{
+	struct proc *child;
+	int result;
+
+	if (options & ~WNOHANG) {
+		return EINVAL;
+	}
+
+	result = proc_waitchild(pid, (options & WNOHANG) != 0, &child);
+	if (result) {
+		return result;
+	}
+	if (child == NULL) {
+		*retval = 0;
+		return 0;
+	}
+
+	if (statusp != NULL) {
+		result = copyout(&child->p_status, statusp, sizeof(int));
+		if (result) {
+			return result;
+		}
+	}
+	proc_destroy(child);
+
+	*retval = pid;
+	return 0;
+}
+
+/*
+ * setpriority: set the nice value of process WHO (0 for the caller)
+ * to PRIO, clamped to PRIO_MIN..PRIO_MAX. Lower is more favoured; see
+ * "Scheduling" in thread.c. There are no process groups or users, so
+ * WHICH must be PRIO_PROCESS.
+ */
+int
+sys_setpriority(int which, pid_t who, int prio)
+{
+	if (which != PRIO_PROCESS) {
+		return EINVAL;
+	}
+	if (prio < PRIO_MIN) {
+		prio = PRIO_MIN;
+	}
+	if (prio > PRIO_MAX) {
+		prio = PRIO_MAX;
+	}
+	return proc_setnice(who, prio);
+}
+
+/*
+ * getpriority: return the nice value of process WHO (0 for the
+ * caller). As the value may be -1, callers tell errors by errno.
+ */
+int
+sys_getpriority(int which, pid_t who, int32_t *retval)
+{
+	int nice, result;
+
+	if (which != PRIO_PROCESS) {
+		return EINVAL;
+	}
+	result = proc_getnice(who, &nice);
+	if (result) {
+		return result;
+	}
+	*retval = nice;
+	return 0;
+}
+#endif
+
+/*
+ * _exit: end the current process. The status is kept for waitpid.
+ */
+void
+sys__exit(int code)
+{
+	proc_exit(_MKWAIT_EXIT(code));
+	thread_exit();
+}
@@ -28,9 +28,9 @@
  */
 
 /*
- * Sample/test code for running a user program.  You can use this for
- * reference when implementing the execv() system call. Remember though
- * that execv() needs to do more than runprogram() does.
+ * Running user programs: runprogram, which starts the first program
+ * of a process from the kernel menu, and exec_program, which it
+ * shares with execv.
  */
 
 #include <types.h>
@@ -43,30 +43,26 @@
 #include <vm.h>
 #include <vfs.h>
 #include <syscall.h>
+#include <argblock.h>
 #include <test.h>
 
 /*
- * Load program "progname" and start running it in usermode.
- * Does not return except on error.
+ * Replace the current program with the executable V, with arguments
+ * AB. The new address space is set up completely, arguments and all,
+ * before the old one is destroyed, so that on failure the caller is
+ * left as it was. The old address space goes only after that, just
+ * before entering user mode; the frames it frees sit in the cpu's
+ * page cache and are the first ones the new program's faults get.
  *
- * Calls vfs_open on progname and thus may destroy it.
+ * Closes V. On success, frees AB and does not return.
  */
 int
-runprogram(char *progname)
+exec_program(struct vnode *v, struct argblock *ab)
 {
-	struct addrspace *as;
-	struct vnode *v;
+	struct addrspace *as, *oldas;
 	vaddr_t entrypoint, stackptr;
-	int result;
-
-	/* Open the file. */
-	result = vfs_open(progname, O_RDONLY, 0, &v);
-	if (result) {
-		return result;
-	}
-
-	/* We should be a new process. */
-	KASSERT(proc_getas() == NULL);
+	userptr_t uargv;
+	int argc, result;
 
 	/* Create a new address space. */
 	as = as_create();
@@ -76,34 +72,77 @@ runprogram(char *progname)
 	}
 
 	/* Switch to it and activate it. */
-	proc_setas(as);
+	oldas = proc_setas(as);
 	as_activate();
 
 	/* Load the executable. */
 	result = load_elf(v, &entrypoint);
-	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		vfs_close(v);
-		return result;
-	}
 
 	/* Done with the file now. */
 	vfs_close(v);
 
+	if (result) {
+		goto fail;
+	}
+
 	/* Define the user stack in the address space */
 	result = as_define_stack(as, &stackptr);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		return result;
+		goto fail;
+	}
+
+	/* Put the arguments on it. */
+	result = argblock_copyout(ab, &stackptr, &uargv);
+	if (result) {
+		goto fail;
+	}
+	argc = ab->ab_argc;
+	argblock_cleanup(ab);
+
+	/* No going back now. */
+	if (oldas != NULL) {
+		as_destroy(oldas);
 	}
 
 	/* Warp to user mode. */
-	enter_new_process(0 /*argc*/, NULL /*userspace addr of argv*/,
+	enter_new_process(argc, uargv,
 			  NULL /*userspace addr of environment*/,
 			  stackptr, entrypoint);
 
 	/* enter_new_process does not return. */
 	panic("enter_new_process returned\n");
 	return EINVAL;
+
+ fail:
+	proc_setas(oldas);
+	as_activate();
+	as_destroy(as);
+	return result;
 }
 
+/*
+ * Load program "progname" and start running it in usermode, with
+ * the arguments in AB (the first being, by convention, the program
+ * name). Does not return except on error; AB is then still the
+ * caller's to clean up.
+ *
+ * Calls vfs_open on progname and thus may destroy it.
+ */
+int
+runprogram(char *progname, struct argblock *ab)
+{
+	struct vnode *v;
+	int result;
+
+	/* We should be a new process. */
+	KASSERT(proc_getas() == NULL);
+
+	/* Open the file. */
+	result = vfs_open(progname, O_RDONLY, 0, &v);
+	if (result) {
+		return result;
+	}
+
+	/* Only returns on failure. */
+	return exec_program(v, ab);
+}
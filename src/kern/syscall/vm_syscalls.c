@@ -0,0 +1,126 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <addrspace.h>
+#include <syscall.h>
+
+/*
+ * Memory management system calls.
+ */
+
+/*
+ * sbrk: move the break by AMOUNT and return the old one. The heap
+ * region grows and shrinks with it; see as_sbrk.
+ */
+int
+sys_sbrk(intptr_t amount, int32_t *retval)
+{
+	struct addrspace *as;
+	vaddr_t oldbreak;
+	int result;
+
+	as = proc_getas();
+	if (as == NULL || as->as_heap == NULL) {
+		return ENOMEM;
+	}
+
+	result = as_sbrk(as, amount, &oldbreak);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int32_t)oldbreak;
+	return 0;
+}
+
+/*
+ * Look up the vnode of the file open on FD for mapping with PROT and
+ * FLAGS. The file must be open for reading, and for writing too if
+ * writes through the mapping are to reach it.
+ */
+static
+int
+mmap_getvnode(int fd, int prot, int flags, struct vnode **ret)
+{
+#if OPT_SYSCALLS
+	struct openfile *of;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+	if (of->of_accmode == O_WRONLY) {
+		return EACCES;
+	}
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE) &&
+	    of->of_accmode != O_RDWR) {
+		return EACCES;
+	}
+	*ret = of->of_vnode;
+	return 0;
+#else
+	(void)fd;
+	(void)prot;
+	(void)flags;
+	(void)ret;
+	return EBADF;
+#endif
+}
+
+/*
+ * mmap: map a file, or anonymous memory with MAP_ANON, and return the
+ * address chosen. See as_mmap.
+ */
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, int32_t *retval)
+{
+	struct addrspace *as;
+	struct vnode *v;
+	vaddr_t base;
+	int result;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+
+	v = NULL;
+	if ((flags & MAP_ANON) == 0) {
+		result = mmap_getvnode(fd, prot, flags, &v);
+		if (result) {
+			return result;
+		}
+	}
+
+	result = as_mmap(as, (vaddr_t)addr, len, prot, flags, v, offset,
+			 &base);
+	if (result) {
+		return result;
+	}
+
+	*retval = (int32_t)base;
+	return 0;
+}
+
+/*
+ * munmap: remove mappings made by mmap.
+ */
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+	struct addrspace *as;
+
+	as = proc_getas();
+	if (as == NULL) {
+		return EINVAL;
+	}
+	return as_munmap(as, (vaddr_t)addr, len);
+}
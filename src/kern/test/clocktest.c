@@ -0,0 +1,142 @@
+/*
+ * Timer interrupt overhead benchmark.
+ */
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <clock.h>
+#include <current.h>
+#include <test.h>
+
+////////////////////////////////////////////////////////////
+// ck1
+
+/*
+ * Measure what each hardclock costs a lone CPU-bound thread.
+ *
+ * The same amount of busywork is timed twice: once in CHUNKS pieces,
+ * each run with interrupts off, and once in one go with interrupts
+ * on. The difference is the time taken by the interrupts that came
+ * in the second run, almost all of which are hardclocks. A chunk is
+ * sized to take about half a tick, so that the interrupts held off
+ * during the first run are never late by more than that.
+ *
+ * For a meaningful result, run it with nothing else going on.
+ */
+
+#define CHUNKS	200
+
+static volatile unsigned ticktest_sink;
+
+static
+void
+ticktest_spin(unsigned iters)
+{
+	unsigned i;
+
+	for (i=0; i<iters; i++) {
+		ticktest_sink += i;
+	}
+}
+
+static
+uint64_t
+ticktest_nsecs(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+/*
+ * Time ITERS iterations of the busywork with interrupts off.
+ */
+static
+uint64_t
+ticktest_quiet(unsigned iters)
+{
+	struct timespec before, after, diff;
+	int spl;
+
+	spl = splhigh();
+	gettime(&before);
+	ticktest_spin(iters);
+	gettime(&after);
+	splx(spl);
+
+	timespec_sub(&after, &before, &diff);
+	return ticktest_nsecs(&diff);
+}
+
+/*
+ * Read this cpu's hardclock count and number consistently.
+ */
+static
+unsigned
+ticktest_hardclocks(unsigned *cpunum)
+{
+	unsigned count;
+	int spl;
+
+	spl = splhigh();
+	count = curcpu->c_hardclocks;
+	*cpunum = curcpu->c_number;
+	splx(spl);
+	return count;
+}
+
+int
+ticktest(int nargs, char **args)
+{
+	struct timespec before, after, diff;
+	uint64_t quiet, busy, overhead;
+	unsigned iters, ticks, startclocks, endclocks, startcpu, endcpu;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting timer overhead test...\n");
+
+	/* Size the chunks at about half a tick. */
+	iters = 1000;
+	while (ticktest_quiet(iters) < 1000000000 / HZ / 2) {
+		iters *= 2;
+	}
+
+	quiet = 0;
+	for (i=0; i<CHUNKS; i++) {
+		quiet += ticktest_quiet(iters);
+	}
+
+	startclocks = ticktest_hardclocks(&startcpu);
+	gettime(&before);
+	ticktest_spin(iters * CHUNKS);
+	gettime(&after);
+	endclocks = ticktest_hardclocks(&endcpu);
+
+	timespec_sub(&after, &before, &diff);
+	busy = ticktest_nsecs(&diff);
+
+	if (startcpu == endcpu) {
+		ticks = endclocks - startclocks;
+	}
+	else {
+		/* We were moved; go by the clock rate instead. */
+		ticks = busy * HZ / 1000000000;
+	}
+	if (ticks == 0) {
+		kprintf("ck1: no hardclocks seen\n");
+		return 1;
+	}
+
+	overhead = busy > quiet ? busy - quiet : 0;
+	kprintf("ck1: %u iterations: %llu ns quiet, %llu ns with interrupts\n",
+		iters * CHUNKS, (unsigned long long)quiet,
+		(unsigned long long)busy);
+	kprintf("ck1: %u hardclocks, %llu ns each (%llu.%02llu%% of the cpu)\n",
+		ticks, (unsigned long long)(overhead / ticks),
+		(unsigned long long)(overhead * 100 / busy),
+		(unsigned long long)(overhead * 10000 / busy % 100));
+	kprintf("Timer overhead test done\n");
+	return 0;
+}
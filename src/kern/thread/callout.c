@@ -0,0 +1,214 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <callout.h>
+
+/*
+ * Timer wheel. See callout.h.
+ *
+ * Everything is protected by callout_lock. Nothing else is locked
+ * under it, except that the timer device is programmed with it held.
+ */
+
+#define NSEC_PER_TICK	1000000
+#define WHEELMASK	(CALLOUT_WHEELSIZE - 1)
+
+static struct spinlock callout_lock = SPINLOCK_INITIALIZER;
+static struct callout *callout_wheel[CALLOUT_WHEELSIZE];
+static unsigned callout_count;		/* callouts on the wheel */
+static uint64_t callout_lasttick;	/* last tick callout_run covered */
+static uint64_t callout_armed;		/* tick the timer is set for, or 0 */
+
+static
+uint64_t
+callout_nsecs(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Program the timer to go off at tick WHEN. NOW is the current time
+ * in nanoseconds.
+ */
+static
+void
+callout_settimer(uint64_t when, uint64_t now)
+{
+	uint64_t due, usecs;
+
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+
+	callout_armed = when;
+	due = when * NSEC_PER_TICK;
+	usecs = due > now ? (due - now + 999) / 1000 : 1;
+	if (usecs > 0xffffffff) {
+		/* over an hour; just check back then */
+		usecs = 0xffffffff;
+	}
+	timerclock_set(usecs);
+}
+
+static
+void
+callout_insert(struct callout *co, uint64_t when)
+{
+	struct callout **slot;
+
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+	KASSERT(!co->co_pending);
+
+	/* Anything already past due runs next time round. */
+	if (when <= callout_lasttick) {
+		when = callout_lasttick + 1;
+	}
+	co->co_when = when;
+
+	slot = &callout_wheel[when & WHEELMASK];
+	co->co_next = *slot;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = &co->co_next;
+	}
+	co->co_prevp = slot;
+	*slot = co;
+	co->co_pending = true;
+	callout_count++;
+}
+
+static
+void
+callout_remove(struct callout *co)
+{
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+	KASSERT(co->co_pending);
+
+	*co->co_prevp = co->co_next;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = co->co_prevp;
+	}
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+	co->co_pending = false;
+	callout_count--;
+}
+
+void
+callout_init(struct callout *co, void (*func)(void *), void *arg)
+{
+	co->co_func = func;
+	co->co_arg = arg;
+	co->co_when = 0;
+	co->co_pending = false;
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+}
+
+void
+callout_schedule(struct callout *co, uint64_t nsecs)
+{
+	uint64_t now;
+
+	now = callout_nsecs();
+
+	spinlock_acquire(&callout_lock);
+	if (co->co_pending) {
+		callout_remove(co);
+	}
+	callout_insert(co, (now + nsecs + NSEC_PER_TICK - 1) / NSEC_PER_TICK);
+	if (callout_armed == 0 || co->co_when < callout_armed) {
+		callout_settimer(co->co_when, now);
+	}
+	spinlock_release(&callout_lock);
+}
+
+bool
+callout_stop(struct callout *co)
+{
+	bool pending;
+
+	spinlock_acquire(&callout_lock);
+	pending = co->co_pending;
+	if (pending) {
+		callout_remove(co);
+	}
+	spinlock_release(&callout_lock);
+
+	/* The timer stays set; going off for nothing is harmless. */
+	return pending;
+}
+
+void
+callout_run(void)
+{
+	struct callout *expired, *co, *next;
+	uint64_t now, tick, first, when;
+
+	expired = NULL;
+	now = callout_nsecs();
+	tick = now / NSEC_PER_TICK;
+
+	spinlock_acquire(&callout_lock);
+	callout_armed = 0;
+
+	/*
+	 * Look at the slots of the ticks since we last ran (but no
+	 * more than one turn of the wheel), picking out the callouts
+	 * that are due, rather than those waiting for a later turn.
+	 */
+	if (tick > callout_lasttick) {
+		first = callout_lasttick + 1;
+		if (tick - callout_lasttick > CALLOUT_WHEELSIZE) {
+			first = tick - CALLOUT_WHEELSIZE + 1;
+		}
+		for (; first <= tick; first++) {
+			for (co = callout_wheel[first & WHEELMASK]; co != NULL;
+			     co = next) {
+				next = co->co_next;
+				if (co->co_when <= tick) {
+					callout_remove(co);
+					co->co_next = expired;
+					expired = co;
+				}
+			}
+		}
+		callout_lasttick = tick;
+	}
+
+	/*
+	 * Set the timer for the earliest callout left, if any. Nothing
+	 * left is due before the next tick, so going forward from there
+	 * the first slot holding a callout due in this turn of the wheel
+	 * has it. If nothing is due for a whole turn, check back then.
+	 */
+	if (callout_count > 0) {
+		when = 0;
+		for (first = callout_lasttick + 1;
+		     when == 0 && first <= callout_lasttick + CALLOUT_WHEELSIZE;
+		     first++) {
+			for (co = callout_wheel[first & WHEELMASK]; co != NULL;
+			     co = co->co_next) {
+				KASSERT(co->co_when >= first);
+				if (co->co_when == first) {
+					when = first;
+					break;
+				}
+			}
+		}
+		if (when == 0) {
+			when = callout_lasttick + CALLOUT_WHEELSIZE;
+		}
+		callout_settimer(when, now);
+	}
+	spinlock_release(&callout_lock);
+
+	/* The owner may reuse a callout once it runs; don't touch it after. */
+	while (expired != NULL) {
+		co = expired;
+		expired = co->co_next;
+		co->co_next = NULL;
+		co->co_func(co->co_arg);
+	}
+}
@@ -32,15 +32,16 @@
 #include <cpu.h>
 #include <wchan.h>
 #include <clock.h>
+#include <callout.h>
 #include <thread.h>
 #include <current.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Callbacks at specific points in the future are callouts (see
+ * callout.h), run from timerclock(). hardclock() is only for
+ * scheduling, and is switched off on idle cpus.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -50,14 +51,16 @@
  * Timing constants. These should be tuned along with any work done on
  * the scheduler.
  */
-#define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define SCHEDULE_HARDCLOCKS	HZ	/* Boost priorities once a second. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Threads in thread_sleep_ns wait on one of SLEEPCHANS wait channels,
+ * picked by hashing the thread, so that a wakeup seldom disturbs
+ * anyone else. All are protected by sleep_lock.
  */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
+#define SLEEPCHANS 16
+static struct wchan *sleepchans[SLEEPCHANS];
+static struct spinlock sleep_lock;
 
 /*
  * Setup.
@@ -65,24 +68,25 @@ static struct spinlock lbolt_lock;
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	unsigned i;
+
+	spinlock_init(&sleep_lock);
+	for (i=0; i<SLEEPCHANS; i++) {
+		sleepchans[i] = wchan_create("sleep");
+		if (sleepchans[i] == NULL) {
+			panic("Couldn't create sleep channels\n");
+		}
 	}
 }
 
 /*
- * This is called once per second, on one processor, by the timer
- * code.
+ * This is called, on one processor, when the timer set by the
+ * callout code goes off.
  */
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
+	callout_run();
 }
 
 /*
@@ -92,18 +96,67 @@ timerclock(void)
 void
 hardclock(void)
 {
+	bool yield;
+
 	/*
 	 * Collect statistics here as desired.
 	 */
 
 	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
-		thread_consider_migration();
-	}
+	yield = thread_hardclock();
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
+		yield = true;
+	}
+	if (yield) {
+		thread_yield();
+	}
+}
+
+/*
+ * A thread in thread_sleep_ns. Lives on the sleeper's stack.
+ */
+struct sleeper {
+	struct callout sl_callout;
+	struct wchan *sl_wchan;
+	bool sl_done;
+};
+
+/*
+ * Callout function for thread_sleep_ns. The sleeper can't see sl_done
+ * and go away until we let go of sleep_lock, after the wakeup.
+ */
+static
+void
+thread_sleep_wakeup(void *data)
+{
+	struct sleeper *sl = data;
+
+	spinlock_acquire(&sleep_lock);
+	sl->sl_done = true;
+	wchan_wakeall(sl->sl_wchan, &sleep_lock);
+	spinlock_release(&sleep_lock);
+}
+
+/*
+ * Suspend execution for NSECS nanoseconds.
+ */
+void
+thread_sleep_ns(uint64_t nsecs)
+{
+	struct sleeper sl;
+
+	sl.sl_wchan = sleepchans[(uintptr_t)curthread / sizeof(struct thread)
+				 % SLEEPCHANS];
+	sl.sl_done = false;
+	callout_init(&sl.sl_callout, thread_sleep_wakeup, &sl);
+
+	spinlock_acquire(&sleep_lock);
+	callout_schedule(&sl.sl_callout, nsecs);
+	while (!sl.sl_done) {
+		wchan_sleep(sl.sl_wchan, &sleep_lock);
 	}
-	thread_yield();
+	spinlock_release(&sleep_lock);
 }
 
 /*
@@ -112,10 +165,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > 0) {
+		thread_sleep_ns((uint64_t)num_secs * 1000000000);
 	}
-	spinlock_release(&lbolt_lock);
 }
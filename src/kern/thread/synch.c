@@ -36,8 +36,10 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
+#include <clock.h>
 #include <synch.h>
 
 ////////////////////////////////////////////////////////////
@@ -138,6 +140,140 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Lock statistics, kept per lock name, so that locks of the same kind
+ * (one per vnode, say) are lumped together. A lock finds its entry
+ * once, in lock_create. Each entry has its own spinlock, taken once
+ * per hold, on release; lockstat_lock only covers handing entries
+ * out. When the table fills up, the last entry takes in the rest.
+ *
+ * Reading the clock costs several bus accesses, too much to do on
+ * every hold of every lock, so only one hold in LOCKSTAT_SAMPLE of
+ * each lock is timed; the average hold time is taken over those.
+ */
+
+#define LOCKSTAT_MAX		64
+#define LOCKSTAT_NAMELEN	24
+#define LOCKSTAT_SAMPLE		64	/* must be a power of 2 */
+
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];	/* lock name, maybe truncated */
+	struct spinlock ls_lock;
+	unsigned ls_acquires;		/* times acquired */
+	unsigned ls_spins;		/* ...after spinning */
+	unsigned ls_sleeps;		/* ...after sleeping */
+	unsigned ls_timed;		/* holds timed */
+	uint64_t ls_holdns;		/* ...and their total time */
+};
+
+static struct spinlock lockstat_lock = SPINLOCK_INITIALIZER;
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static unsigned lockstat_count;
+
+static
+struct lockstat *
+lockstat_get(const char *name)
+{
+	char shortname[LOCKSTAT_NAMELEN];
+	struct lockstat *ls;
+	unsigned i;
+
+	snprintf(shortname, sizeof(shortname), "%s", name);
+
+	spinlock_acquire(&lockstat_lock);
+	ls = NULL;
+	for (i=0; i<lockstat_count && ls == NULL; i++) {
+		if (!strcmp(lockstats[i].ls_name, shortname)) {
+			ls = &lockstats[i];
+		}
+	}
+	if (ls == NULL && lockstat_count == LOCKSTAT_MAX) {
+		ls = &lockstats[LOCKSTAT_MAX - 1];
+	}
+	if (ls == NULL) {
+		ls = &lockstats[lockstat_count++];
+		strcpy(ls->ls_name, lockstat_count == LOCKSTAT_MAX ?
+		       "(other)" : shortname);
+		spinlock_init(&ls->ls_lock);
+	}
+	spinlock_release(&lockstat_lock);
+	return ls;
+}
+
+/*
+ * Current time for hold times, or 0 while there is no clock yet
+ * (locks are used during autoconfiguration, which finds the clock).
+ */
+static
+uint64_t
+lockstat_nsecs(void)
+{
+	struct timespec ts;
+
+	if (!gettime_ready()) {
+		return 0;
+	}
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+lock_printstats(void)
+{
+	struct lockstat *ls;
+	unsigned i, count, acquires, spins, sleeps, timed;
+	uint64_t holdns, avg;
+
+	spinlock_acquire(&lockstat_lock);
+	count = lockstat_count;
+	spinlock_release(&lockstat_lock);
+
+	kprintf("%-24s %10s %8s %8s %8s %10s\n", "lock", "acquires",
+		"spins", "sleeps", "timed", "avg ns");
+	for (i=0; i<count; i++) {
+		/* copy under the lock; ls_holdns is not read atomically */
+		ls = &lockstats[i];
+		spinlock_acquire(&ls->ls_lock);
+		acquires = ls->ls_acquires;
+		spins = ls->ls_spins;
+		sleeps = ls->ls_sleeps;
+		timed = ls->ls_timed;
+		holdns = ls->ls_holdns;
+		spinlock_release(&ls->ls_lock);
+
+		if (acquires == 0) {
+			continue;
+		}
+		avg = timed > 0 ? holdns / timed : 0;
+		kprintf("%-24s %10u %8u %8u %8u %10llu\n", ls->ls_name,
+			acquires, spins, sleeps, timed,
+			(unsigned long long)avg);
+	}
+}
+
+#if !USE_SEMAPHORE_FOR_LOCK
+/*
+ * Is T running on cpu C, which is not ours? c_curthread alone is not
+ * enough: it still points at a thread that has gone to sleep, while
+ * C idles or is on its way to the next thread. So T must also be in
+ * S_RUN and C must not be idle.
+ *
+ * None of this is locked, so the answer may be stale by the time it
+ * is used; that only costs some extra spinning or a sleep that could
+ * have been avoided. Callers have just seen T own the lock, so T
+ * cannot have exited yet when its t_state is read.
+ */
+static
+bool
+lock_owner_running(struct thread *t, struct cpu *c)
+{
+	return c != curcpu->c_self &&
+		((volatile struct cpu *)c)->c_curthread == t &&
+		((volatile struct thread *)t)->t_state == S_RUN &&
+		!((volatile struct cpu *)c)->c_isidle;
+}
+#endif
+
 struct lock *
 lock_create(const char *name)
 {
@@ -176,6 +312,11 @@ lock_create(const char *name)
 #endif
         lock->lk_owner = NULL;                          // setta ownership a zero, perchè nessuno l'ha ancora acquisito
         spinlock_init(&lock->lk_lock);
+	lock->lk_stat = lockstat_get(name);
+	lock->lk_holds = 0;
+	lock->lk_acquired = 0;
+	lock->lk_spun = false;
+	lock->lk_slept = false;
         return lock;
         
 }
@@ -204,8 +345,11 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
-
-        // Write this
+#if !USE_SEMAPHORE_FOR_LOCK
+	struct thread *owner;
+	struct cpu *ownercpu;
+#endif
+	bool spun, slept;
 
         KASSERT(lock != NULL);
         if (lock_do_i_hold(lock)){                      // verifica che questo thread non abbia già acquisito questo lock
@@ -215,19 +359,46 @@ lock_acquire(struct lock *lock)
 
         KASSERT(curthread->t_in_interrupt == false);    // verifica che non ci siano interrupt, perché non si può acquisire un lock durante un interrupt
 
+	spun = slept = false;
 #if USE_SEMAPHORE_FOR_LOCK
         P(lock->lk_sem);                                // probe su lock. Se occupato, va in sleep (wchan_sleep) finchè non si libera. SEMAFORO BINARIO GARANTISCE L'OWNERSHIP UNICA!
         spinlock_acquire(&lock->lk_lock);
 #else   
         spinlock_acquire(&lock->lk_lock);                       // acquire su spinlock interno
         while (lock->lk_owner != NULL){                 // aspetto finchè esiste già un Owner. Stiamo quindi verificando attivamente noi l'Ownership!
-                wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		/*
+		 * The owner can't go away while it holds the lock,
+		 * so its t_cpu can be looked at here. If it is
+		 * running, spin (without lk_lock, so it can let go)
+		 * until it lets go or stops running; otherwise it is
+		 * not letting go soon, so sleep.
+		 */
+		owner = (struct thread *)lock->lk_owner;
+		ownercpu = owner->t_cpu;
+		if (lock_owner_running(owner, ownercpu)) {
+			spun = true;
+			spinlock_release(&lock->lk_lock);
+			while (lock->lk_owner == owner &&
+			       lock_owner_running(owner, ownercpu)) {
+				/* spin */
+			}
+			spinlock_acquire(&lock->lk_lock);
+		}
+		else {
+			slept = true;
+			wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		}
         }
 #endif
         KASSERT(lock->lk_owner == NULL);
         lock->lk_owner=curthread;                       // ora settiamo che siamo noi il thread che ha (l'unica) ownership!
         spinlock_release(&lock->lk_lock);                       // release su spinlock interno
 
+	lock->lk_spun = spun;
+	lock->lk_slept = slept;
+	lock->lk_holds++;
+	lock->lk_acquired = (lock->lk_holds & (LOCKSTAT_SAMPLE - 1)) == 0 ?
+		lockstat_nsecs() : 0;
 }
 
 // --------------------------------------------
@@ -235,10 +406,20 @@ lock_acquire(struct lock *lock)
 void
 lock_release(struct lock *lock)
 {
-        // Write this
+	struct lockstat *ls;
+	uint64_t held;
+	bool spun, slept, timed;
 
         KASSERT(lock != NULL);
         KASSERT(lock_do_i_hold(lock));                  // verifica che questo thread SIA in possesso di questo lock
+
+	/* lk_acquired is 0 if this hold is not being timed */
+	timed = lock->lk_acquired != 0;
+
+	held = timed ? lockstat_nsecs() - lock->lk_acquired : 0;
+	spun = lock->lk_spun;
+	slept = lock->lk_slept;
+
         spinlock_acquire(&lock->lk_lock);                       // acquire su spinlock interno
         lock->lk_owner = NULL;                          // resetta ownership
 #if USE_SEMAPHORE_FOR_LOCK
@@ -248,6 +429,20 @@ lock_release(struct lock *lock)
 #endif
         spinlock_release(&lock->lk_lock);                       // release su spinlock interno
 
+	ls = lock->lk_stat;
+	spinlock_acquire(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (spun) {
+		ls->ls_spins++;
+	}
+	if (slept) {
+		ls->ls_sleeps++;
+	}
+	if (timed) {
+		ls->ls_timed++;
+		ls->ls_holdns += held;
+	}
+	spinlock_release(&ls->ls_lock);
 }
 
 // --------------------------------------------
@@ -255,18 +450,11 @@ lock_release(struct lock *lock)
 bool
 lock_do_i_hold(struct lock *lock)                       // serve a verificare se il thread corrente possiede o meno il lock
 {
-        // Write this
-#if OPT_SYNCH
-        bool res;
-	spinlock_acquire(&lock->lk_lock);
-	res = lock->lk_owner == curthread;              // se siamo i possessori di questo thread ritorna true, altrimenti false 
-	spinlock_release(&lock->lk_lock);
-	return res;
-#endif
-
-        (void)lock;  // suppress warning until code gets written
-
-        return true; // dummy until code gets written
+	/*
+	 * Only we can make lk_owner point to us, or stop it from
+	 * doing so, so this needs no lock.
+	 */
+	return lock->lk_owner == curthread;             // se siamo i possessori di questo thread ritorna true, altrimenti false 
 }
 
 ////////////////////////////////////////////////////////////
@@ -291,7 +479,6 @@ cv_create(const char *name)                             // identico a lock_creat
         }
 
         // add stuff here as needed
-#if OPT_SYNCH
 	cv->cv_wchan = wchan_create(cv->cv_name);
 	if (cv->cv_wchan == NULL) {
 	        kfree(cv->cv_name);
@@ -299,7 +486,6 @@ cv_create(const char *name)                             // identico a lock_creat
 		return NULL;
 	}
         spinlock_init(&cv->cv_lock);
-#endif
         return cv;
 }
 
@@ -309,10 +495,8 @@ cv_destroy(struct cv *cv)                               // identico a lock_destr
         KASSERT(cv != NULL);
 
         // add stuff here as needed
-#if OPT_SYNCH
 	spinlock_cleanup(&cv->cv_lock);
 	wchan_destroy(cv->cv_wchan);
-#endif
         kfree(cv->cv_name);
         kfree(cv);
 }
@@ -320,8 +504,6 @@ cv_destroy(struct cv *cv)                               // identico a lock_destr
 void
 cv_wait(struct cv *cv, struct lock *lock)               // assumi che il lock sia già stato preso!
 {
-        // Write this
-#if OPT_SYNCH
         KASSERT(lock != NULL);
 	KASSERT(cv != NULL);
 	KASSERT(lock_do_i_hold(lock));                          // deve possedere il lock!
@@ -331,41 +513,27 @@ cv_wait(struct cv *cv, struct lock *lock)               // assumi che il lock si
 	wchan_sleep(cv->cv_wchan,&cv->cv_lock);                 // aspetta un wakeone dal cv_signal
 	spinlock_release(&cv->cv_lock);                         // non serve più questo cv, quindi rilascio il lock
 	lock_acquire(lock);                                             // riprendo il lock esterno dopo segnale
-#endif
-
-        (void)cv;    // suppress warning until code gets written
-        (void)lock;  // suppress warning until code gets written
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)             // assumi che il lock sia già stato preso!
 {
-        // Write this
-#if OPT_SYNCH
         KASSERT(lock != NULL);
 	KASSERT(cv != NULL);
 	KASSERT(lock_do_i_hold(lock));                          // verifica che sono effettivamente il possessore del lock
 	spinlock_acquire(&cv->cv_lock);
 	wchan_wakeone(cv->cv_wchan,&cv->cv_lock);               // sveglia un thread dalla coda di wait
 	spinlock_release(&cv->cv_lock);
-#endif
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)          // identico a signal, cambia solo il wakeall
 {
-	// Write this
-#if OPT_SYNCH
         KASSERT(lock != NULL);
 	KASSERT(cv != NULL);
 	KASSERT(lock_do_i_hold(lock));
 	spinlock_acquire(&cv->cv_lock);
 	wchan_wakeall(cv->cv_wchan,&cv->cv_lock);
 	spinlock_release(&cv->cv_lock);
-#endif
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
 }
 
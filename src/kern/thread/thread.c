@@ -35,6 +35,8 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/time.h>	/* for kern/resource.h */
+#include <kern/resource.h>
 #include <lib.h>
 #include <array.h>
 #include <cpu.h>
@@ -108,6 +110,148 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Scheduling.
+ *
+ * This is a multilevel feedback queue. Each cpu's run queue has
+ * SCHED_NLEVELS lists, and the next thread to run is always taken
+ * from the highest (lowest-numbered) level that has one.
+ *
+ * A thread's nice value sets the highest level it may reach
+ * (sched_toplevel), where it starts out. Each time it uses up a
+ * whole quantum it drops a level; quanta get longer further down.
+ * Each time it wakes up from wchan_sleep it rises a level. Threads
+ * that mostly sleep, like the shell, thus stay above those that
+ * mostly compute, and preempt them at the next hardclock. Once a
+ * second schedule() lifts everything on the run queue back to its
+ * top level, so nothing starves for long.
+ */
+
+/* Hardclocks a thread may run at LEVEL before dropping a level. */
+#define SCHED_QUANTUM(level) (1 + (level) / 2)
+
+/*
+ * Return the highest level a thread with nice value NICE may reach.
+ * Nice 0 maps to the middle of the range, so that positive and
+ * negative values both make a difference.
+ */
+static
+unsigned
+sched_toplevel(int nice)
+{
+	KASSERT(nice >= PRIO_MIN && nice <= PRIO_MAX);
+	return (nice - PRIO_MIN) * SCHED_NLEVELS / (PRIO_MAX - PRIO_MIN + 1);
+}
+
+/*
+ * Run queue operations. The caller holds the run queue lock of C.
+ */
+static
+void
+runqueue_add(struct cpu *c, struct thread *t)
+{
+	KASSERT(t->t_level < SCHED_NLEVELS);
+	threadlist_addtail(&c->c_runqueue[t->t_level], t);
+	c->c_runqueue_count++;
+}
+
+/* Return the highest level with a thread on it, or SCHED_NLEVELS. */
+static
+unsigned
+runqueue_toplevel(struct cpu *c)
+{
+	unsigned i;
+
+	if (c->c_runqueue_count == 0) {
+		return SCHED_NLEVELS;
+	}
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			break;
+		}
+	}
+	return i;
+}
+
+/* Take the next thread to run, or NULL if there is none. */
+static
+struct thread *
+runqueue_remhead(struct cpu *c)
+{
+	unsigned level;
+
+	level = runqueue_toplevel(c);
+	if (level == SCHED_NLEVELS) {
+		return NULL;
+	}
+	c->c_runqueue_count--;
+	return threadlist_remhead(&c->c_runqueue[level]);
+}
+
+/* Take the thread that would run last, or NULL if there is none. */
+static
+struct thread *
+runqueue_remtail(struct cpu *c)
+{
+	unsigned i;
+
+	if (c->c_runqueue_count == 0) {
+		return NULL;
+	}
+	for (i=SCHED_NLEVELS; i-- > 0; ) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			c->c_runqueue_count--;
+			return threadlist_remtail(&c->c_runqueue[i]);
+		}
+	}
+	panic("runqueue_remtail: count is %u but queue is empty\n",
+	      c->c_runqueue_count);
+}
+
+/*
+ * Move T to level LEVEL, or the nearest its nice value allows, and
+ * give it a fresh quantum there. T must not be on a run queue.
+ */
+static
+void
+sched_setlevel(struct thread *t, unsigned level)
+{
+	unsigned top;
+
+	top = sched_toplevel(t->t_nice);
+	if (level < top) {
+		level = top;
+	}
+	if (level >= SCHED_NLEVELS) {
+		level = SCHED_NLEVELS - 1;
+	}
+	t->t_level = level;
+	t->t_ticks = 0;
+}
+
+/*
+ * Pick up a change to the nice value of T's process. T keeps its
+ * distance below its top level, so that a thread lifted or lowered
+ * by setpriority() is not left at the old one. Call with interrupts
+ * off on T's own cpu; t_proc changes only then.
+ */
+static
+void
+sched_renice(struct thread *t)
+{
+	unsigned oldtop, newtop, level;
+
+	if (t->t_proc == NULL || t->t_nice == t->t_proc->p_nice) {
+		return;
+	}
+	oldtop = sched_toplevel(t->t_nice);
+	t->t_nice = t->t_proc->p_nice;
+	newtop = sched_toplevel(t->t_nice);
+
+	level = t->t_level > oldtop ? t->t_level - oldtop : 0;
+	sched_setlevel(t, newtop + level);
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -141,6 +285,8 @@ thread_create(const char *name)														// ----------------------Thread Cre
 	thread->t_cpu = NULL;																	// cpu
 	thread->t_proc = NULL;																	// proc
 	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+	thread->t_nice = 0;
+	sched_setlevel(thread, 0);
 
 	/* Interrupt state fields */														// inizializzazione dei campi per gli interrupt
 	thread->t_in_interrupt = false;
@@ -164,6 +310,7 @@ struct cpu *
 cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
+	unsigned i;
 	int result;
 	char namebuf[16];
 
@@ -179,13 +326,34 @@ cpu_create(unsigned hardware_number)
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	spinlock_init(&c->c_pagecache_lock);
+	c->c_pagecache_count = 0;
+	c->c_pagecache_allocs = 0;
+	c->c_pagecache_frees = 0;
+	c->c_pagecache_nkernel = 0;
+	c->c_pagecache_nuser = 0;
+	c->c_tlb_victim = 0;
+	c->c_tlb_filled = 0;
+	c->c_tlb_hole = -1;
+	c->c_tlb_misses = 0;
+	c->c_tlb_refills = 0;
+	c->c_tlb_readonly = 0;
+	c->c_tlb_evictions = 0;
+	c->c_tlb_as = NULL;
+	c->c_steals = 0;
+	c->c_migrations = 0;
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
+	c->c_runqueue_count = 0;
 	spinlock_init(&c->c_runqueue_lock);
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdown_all = false;
+	c->c_shootdown_gen = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -252,6 +420,23 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+/*
+ * Return the number of cpus, and the cpu with software number N.
+ * Used to collect per-cpu statistics.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned n)
+{
+	KASSERT(n < cpuarray_num(&allcpus));
+	return cpuarray_get(&allcpus, n);
+}
+
 /*
  * Destroy a thread.
  *
@@ -314,6 +499,9 @@ exorcise(void)
 void
 thread_panic(void)
 {
+	struct threadlist *rq;
+	unsigned i;
+
 	/*
 	 * Kill off other CPUs.
 	 *
@@ -328,9 +516,13 @@ thread_panic(void)
 	 * to.  Instead, blat the list structure by hand, and take the
 	 * risk that it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = &curcpu->c_runqueue.tl_tail;
-	curcpu->c_runqueue.tl_tail.tln_prev = &curcpu->c_runqueue.tl_head;
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		rq = &curcpu->c_runqueue[i];
+		rq->tl_count = 0;
+		rq->tl_head.tln_next = &rq->tl_tail;
+		rq->tl_tail.tln_prev = &rq->tl_head;
+	}
+	curcpu->c_runqueue_count = 0;
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -442,6 +634,132 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Work stealing.
+ *
+ * A cpu with nothing to run calls this from the idle loop in
+ * thread_switch, without its own run queue lock. It picks the other
+ * cpu with the most threads ready to run and takes half of them, from
+ * the tail of its run queue (the threads that would wait longest).
+ * The victim's run queue lock is taken once; the counts used to pick
+ * it are read without locks, so the choice may be stale, which at
+ * worst wastes a try. Idle cpus come back here after every interrupt,
+ * so new work is picked up within a hardclock.
+ *
+ * Migrating threads isn't free because of cache affinity, but
+ * System/161 does not (yet) model such cache effects, so we're
+ * aggressive and steal whenever there is anything to take.
+ *
+ * Returns true if any threads were taken.
+ */
+static
+bool
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct threadlist stolen;
+	struct thread *t;
+	unsigned i, numcpus, count, most, n;
+
+	victim = NULL;
+	most = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		count = c->c_runqueue_count;
+		if (count > most) {
+			most = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return false;
+	}
+
+	threadlist_init(&stolen);
+	spinlock_acquire(&victim->c_runqueue_lock);
+	n = DIVROUNDUP(victim->c_runqueue_count, 2);
+	while (n > 0 && (t = runqueue_remtail(victim)) != NULL) {
+		/*
+		 * Ordinarily the victim's curthread will not appear on
+		 * its run queue. However, it can if it went to sleep,
+		 * the victim went idle (so it remained curthread), and
+		 * it was woken up before the victim fully unidled. It
+		 * is still running the idle loop on its own stack, so
+		 * it must not move; put it back and make do with what
+		 * we have.
+		 */
+		if (t == victim->c_curthread) {
+			runqueue_add(victim, t);
+			break;
+		}
+		t->t_cpu = curcpu->c_self;
+		threadlist_addhead(&stolen, t);
+		n--;
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (threadlist_isempty(&stolen)) {
+		threadlist_cleanup(&stolen);
+		return false;
+	}
+
+	curcpu->c_steals++;
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	while ((t = threadlist_remhead(&stolen)) != NULL) {
+		DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+		      t->t_name, victim->c_number, curcpu->c_number);
+		runqueue_add(curcpu, t);
+		curcpu->c_migrations++;
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+	threadlist_cleanup(&stolen);
+	return true;
+}
+
+/*
+ * Raise T a level as it wakes up. It keeps the ticks already charged
+ * against its quantum, so a thread that sleeps briefly just before
+ * its quantum runs out does not keep its place by doing so.
+ */
+static
+void
+sched_wakeup(struct thread *t)
+{
+	unsigned ticks;
+
+	ticks = t->t_ticks;
+	sched_setlevel(t, t->t_level > 0 ? t->t_level - 1 : 0);
+	t->t_ticks = ticks;
+}
+
+/*
+ * A thread has been queued on BUSY, which is running something else.
+ * Idle cpus take no hardclocks, so they would not notice; poke one,
+ * if there is any, to come and steal it. c_isidle is peeked at
+ * without locks, so we may poke a cpu that has just found work, which
+ * is harmless, or miss one that has just gone idle, which only delays
+ * things until the next wakeup.
+ */
+static
+void
+thread_poke_idle(struct cpu *busy)
+{
+	unsigned i;
+	struct cpu *c;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != busy && c != curcpu->c_self && c->c_isidle) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
+		}
+	}
+}
+
 /*
  * Make a thread runnable.
  *
@@ -466,7 +784,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)					// -----
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;															// settiamo stato a READY
-	threadlist_addtail(&targetcpu->c_runqueue, target);									// aggiungiamo il thread alla lista di scheduling
+	runqueue_add(targetcpu, target);													// aggiungiamo il thread alla lista di scheduling
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -475,6 +793,14 @@ thread_make_runnable(struct thread *target, bool already_have_lock)					// -----
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else if (!targetcpu->c_isidle && !already_have_lock) {
+		/*
+		 * The thread has to wait; see if someone else wants
+		 * it. (With the lock already held, this is the cpu
+		 * requeueing its own thread as it switches.)
+		 */
+		thread_poke_idle(targetcpu);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
@@ -482,21 +808,14 @@ thread_make_runnable(struct thread *target, bool already_have_lock)					// -----
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common part of thread_fork and thread_fork_trapframe: create a
+ * thread with a stack, attached to process PROC (or the caller's, if
+ * PROC is null). The caller sets up its switchframe and makes it
+ * runnable.
  */
+static
 int
-thread_fork(														// ----------------------Thread Fork----------------------
-		const char *name,
-        struct proc *proc,															// processo a cui associare il thread (se NULL eredita dal chiamante)
-        void (*entrypoint)(void *data1, unsigned long data2),						// funzione di ingresso del nuovo thread
-        void *data1, unsigned long data2)											// parametri per la funzione di ingresso
+thread_fork_create(const char *name, struct proc *proc, struct thread **ret)
 {
     struct thread *newthread;
     int result;
@@ -525,6 +844,10 @@ thread_fork(														// ----------------------Thread Fork------------------
     if (proc == NULL) {
         proc = curthread->t_proc;													// se proc è NULL, eredita il processo del thread chiamante
     }
+
+    /* Start at the top level the process's nice value allows */
+    newthread->t_nice = proc->p_nice;
+    sched_setlevel(newthread, 0);
     result = proc_addthread(proc, newthread);										// aggiunge il nuovo thread alla lista dei thread del processo (quanti, non quali!)
     if (result) {
         /* thread_destroy will clean up the stack */
@@ -539,6 +862,35 @@ thread_fork(														// ----------------------Thread Fork------------------
      */
     newthread->t_iplhigh_count++;													// incrementa il contatore IPL per la gestione degli interrupt
 
+    *ret = newthread;
+    return 0;
+}
+
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(														// ----------------------Thread Fork----------------------
+		const char *name,
+        struct proc *proc,															// processo a cui associare il thread (se NULL eredita dal chiamante)
+        void (*entrypoint)(void *data1, unsigned long data2),						// funzione di ingresso del nuovo thread
+        void *data1, unsigned long data2)											// parametri per la funzione di ingresso
+{
+    struct thread *newthread;
+    int result;
+
+    result = thread_fork_create(name, proc, &newthread);
+    if (result) {
+        return result;
+    }
+
     /* Set up the switchframe so entrypoint() gets called */
     switchframe_init(newthread, entrypoint, data1, data2);							// prepara il contesto di esecuzione per chiamare entrypoint (così dopo context switch parte da entrypoint)
 
@@ -548,6 +900,31 @@ thread_fork(														// ----------------------Thread Fork------------------
     return 0;																		
 }
 
+/*
+ * Create the thread of a forked process. Rather than handing a copy
+ * of the parent's trapframe to an entry function, which would then
+ * have to copy it again onto its own stack, the copy is put on the
+ * new thread's stack up front and the thread starts in
+ * enter_forked_process.
+ */
+int
+thread_fork_trapframe(const char *name, struct proc *proc,
+		      const struct trapframe *tf)
+{
+	struct thread *newthread;
+	int result;
+
+	result = thread_fork_create(name, proc, &newthread);
+	if (result) {
+		return result;
+	}
+
+	switchframe_init_trapframe(newthread, tf);
+	thread_make_runnable(newthread, false);
+
+	return 0;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -564,6 +941,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {																								// Cambia il thread corrente con un altro, cambiando anche stato
     struct thread *cur, *next; 																	
     int spl; 																					// Variabile per salvare il livello di interrupt
+    bool tickless;
 
     DEBUGASSERT(curcpu->c_curthread == curthread); 	
     DEBUGASSERT(curthread->t_cpu == curcpu->c_self);
@@ -588,8 +966,16 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
     /* Lock the run queue. */
     spinlock_acquire(&curcpu->c_runqueue_lock); 												// Acquisisce il lock sulla runqueue della CPU
 
-    /* Micro-optimization: if nothing to do, just return */
-    if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) { 						// Se non ci sono altri thread pronti
+    /*
+     * Micro-optimization: if nothing to do, just return. Yielding
+     * gives way to any thread at our own level or above, so nothing
+     * to do means nothing runnable there. Pick up a new nice value
+     * first, so that we compare from the level we really belong at.
+     */
+    if (newstate == S_READY) {
+        sched_renice(cur);
+    }
+    if (newstate == S_READY && runqueue_toplevel(curcpu) > cur->t_level) { 						// Se non ci sono altri thread pronti
         spinlock_release(&curcpu->c_runqueue_lock);													// Rilascia il lock
         splx(spl); 																					// Ripristina il livello di interrupt
         return; 																					// Esce dalla funzione
@@ -639,17 +1025,32 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
      * lock to look at it, this should not be visible or matter.
      */
 
-    /* The current cpu is now idle. */
+    /*
+     * The current cpu is now idle. While it actually idles, its
+     * hardclock is off: there is nothing for it to do, and wakeups
+     * (including those of sleeps, see callout.c) and work for it to
+     * steal arrive as other interrupts.
+     */
     curcpu->c_isidle = true; // Segna la CPU come idle
+    tickless = false;
     do {
-        next = threadlist_remhead(&curcpu->c_runqueue); 											// Prende il prossimo thread dalla runqueue
+        next = runqueue_remhead(curcpu); 															// Prende il prossimo thread dalla runqueue
         if (next == NULL) { 																		// Se non c'è nessun thread pronto
             spinlock_release(&curcpu->c_runqueue_lock); 												// Rilascia il lock sulla runqueue
-            cpu_idle(); 																				// Mette la CPU in idle finché non arriva un interrupt
+            if (!thread_steal()) {
+                if (!tickless) {
+                    mainbus_hardclock_stop();
+                    tickless = true;
+                }
+                cpu_idle(); 																			// Mette la CPU in idle finché non arriva un interrupt
+            }
             spinlock_acquire(&curcpu->c_runqueue_lock); 												// Riacquisisce il lock sulla runqueue
         }
     } while (next == NULL); 																			// Ripete finché non trova un thread pronto
     curcpu->c_isidle = false; 																		// La CPU non è più idle
+    if (tickless) {
+        mainbus_hardclock_start();
+    }
 
     /*
      * Note that curcpu->c_curthread may be the same variable as
@@ -787,7 +1188,10 @@ thread_exit(void)																			// ----------------------Thread Exit--------
 	 * Detach from our process. You might need to move this action
 	 * around, depending on how your wait/exit works.
 	 */
-	proc_remthread(cur);																		// rimuove un thread dal processo corrente
+	if (cur->t_proc != NULL) {
+		/* _exit detaches before waking up the parent */
+		proc_remthread(cur);																	// rimuove un thread dal processo corrente
+	}
 
 	/* Make sure we *are* detached (move this only if you're sure!) */
 	KASSERT(cur->t_proc == NULL);
@@ -803,151 +1207,119 @@ thread_exit(void)																			// ----------------------Thread Exit--------
 
 /*
  * Yield the cpu to another process, but stay runnable.
+ *
+ * If the run queue is empty thread_switch would only pick us again,
+ * so don't bother. (As in thread_hardclock, the count is read without
+ * the lock.)
  */
 void
 thread_yield(void)																			//----------------------Thread Yield----------------------
 {
+	if (curcpu->c_runqueue_count == 0) {
+		return;
+	}
 	thread_switch(S_READY, NULL, NULL);															// forza un context switch, mettendosi da parte (RUNNING -> READY)
 }
 
 ////////////////////////////////////////////////////////////
 
 /*
- * Scheduler.
+ * Charge the current thread for a hardclock, as described under
+ * "Scheduling" above. Called from hardclock() with interrupts off.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * The nice value is picked up from the process here, so that
+ * setpriority() on another process takes effect within a tick.
+ * t_proc only changes with interrupts off on the thread's own cpu,
+ * so it can be looked at safely.
  */
-
-void
-schedule(void)
+bool
+thread_hardclock(void)
 {
+	struct thread *cur = curthread;
+	bool expired, yield;
+
+	if (curcpu->c_isidle) {
+		return false;
+	}
+
+	sched_renice(cur);
+
+	expired = false;
+	cur->t_ticks++;
+	if (cur->t_ticks >= SCHED_QUANTUM(cur->t_level)) {
+		sched_setlevel(cur, cur->t_level + 1);
+		expired = true;
+	}
+
 	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
+	 * With nothing else ready there is nobody to yield to, and
+	 * the thread just goes on with a fresh quantum. The count is
+	 * looked at without the run queue lock so that a lone thread
+	 * doesn't pay for it every tick; a thread queued just after
+	 * we look waits for the next tick, as it would have anyway.
 	 */
+	if (curcpu->c_runqueue_count == 0) {
+		return false;
+	}
+	if (expired) {
+		return true;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	yield = runqueue_toplevel(curcpu) < cur->t_level;
+	spinlock_release(&curcpu->c_runqueue_lock);
+	return yield;
 }
 
 /*
- * Thread migration.
- *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
- *
- * Migrating threads isn't free because of cache affinity; a thread's
- * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
+ * Scheduler.
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * This is called periodically from hardclock(). It lifts the current
+ * thread and every thread on the current CPU's run queue back to the
+ * top level they may reach, so that threads that have sunk to the
+ * bottom get to run now and then. Sleeping threads are left alone;
+ * they rise as they wake up.
  */
 void
-thread_consider_migration(void)
+schedule(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
+	struct threadlist boosted;
 	struct thread *t;
 
-	my_count = total_count = 0;
-	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
+	if (!curcpu->c_isidle) {
+		sched_setlevel(curthread, 0);
 	}
-
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	if (curcpu->c_runqueue_count == 0) {
 		return;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
+	threadlist_init(&boosted);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	while ((t = runqueue_remhead(curcpu)) != NULL) {
+		sched_setlevel(t, 0);
+		threadlist_addtail(&boosted, t);
+	}
+	while ((t = threadlist_remhead(&boosted)) != NULL) {
+		runqueue_add(curcpu, t);
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
+	threadlist_cleanup(&boosted);
+}
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
-		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
-		}
-		spinlock_release(&c->c_runqueue_lock);
-	}
+/*
+ * Print the work stealing counters of each cpu.
+ */
+void
+thread_printstats(void)
+{
+	unsigned i;
+	struct cpu *c;
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
-		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("cpu%u: %u steals, %u threads migrated in\n",
+			c->c_number, c->c_steals, c->c_migrations);
 	}
-
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
 }
 
 ////////////////////////////////////////////////////////////
@@ -1039,6 +1411,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 * in thread_switch.
 	 */
 
+	sched_wakeup(target);
 	thread_make_runnable(target, false);
 }
 
@@ -1069,6 +1442,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		sched_wakeup(target);
 		thread_make_runnable(target, false);
 	}
 
@@ -1130,25 +1504,17 @@ ipi_broadcast(int code)
 /*
  * Send a TLB shootdown IPI to the specified CPU.
  */
-void
+unsigned
 ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 {
-	unsigned n;
+	unsigned n, gen;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
 	n = target->c_numshootdown;
 	if (n == TLBSHOOTDOWN_MAX) {
-		/*
-		 * If you have problems with this panic going off,
-		 * consider: (1) increasing the maximum, (2) putting
-		 * logic here to sleep until space appears (may
-		 * interact awkwardly with VM system locking), (3)
-		 * putting logic here to coalesce requests together,
-		 * and/or (4) improving VM system state tracking to
-		 * reduce the number of unnecessary shootdowns.
-		 */
-		panic("ipi_tlbshootdown: Too many shootdowns queued\n");
+		/* Too many to do one at a time; flush everything. */
+		target->c_shootdown_all = true;
 	}
 	else {
 		target->c_shootdown[n] = *mapping;
@@ -1158,7 +1524,11 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
 	mainbus_send_ipi(target);
 
+	/* Everything queued now is handled in the next batch. */
+	gen = target->c_shootdown_gen + 1;
+
 	spinlock_release(&target->c_ipi_lock);
+	return gen;
 }
 
 /*
@@ -1202,10 +1572,17 @@ interprocessor_interrupt(void)
 		 * need to release the ipi lock while calling
 		 * vm_tlbshootdown.
 		 */
-		for (i=0; i<curcpu->c_numshootdown; i++) {
-			vm_tlbshootdown(&curcpu->c_shootdown[i]);
+		if (curcpu->c_shootdown_all) {
+			vm_tlbshootdown_all();
+		}
+		else {
+			for (i=0; i<curcpu->c_numshootdown; i++) {
+				vm_tlbshootdown(&curcpu->c_shootdown[i]);
+			}
 		}
 		curcpu->c_numshootdown = 0;
+		curcpu->c_shootdown_all = false;
+		curcpu->c_shootdown_gen++;
 	}
 
 	curcpu->c_ipi_pending = 0;
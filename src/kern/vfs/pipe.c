@@ -0,0 +1,342 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <stat.h>
+#include <lib.h>
+#include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <pipe.h>
+
+/*
+ * Pipes. See pipe.h.
+ */
+
+struct pipe {
+	struct vnode pp_rvnode;		/* read end */
+	struct vnode pp_wvnode;		/* write end */
+	char *pp_buf;			/* PIPE_SIZE bytes */
+	unsigned pp_head;		/* where the next byte goes in */
+	unsigned pp_count;		/* bytes in the buffer */
+	bool pp_readers;		/* read end still open */
+	bool pp_writers;		/* write end still open */
+	struct lock *pp_lock;		/* protects all of the above */
+	struct cv *pp_readcv;		/* readers waiting, pipe empty */
+	struct cv *pp_writecv;		/* writers waiting, pipe full */
+};
+
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	cv_destroy(pp->pp_writecv);
+	cv_destroy(pp->pp_readcv);
+	lock_destroy(pp->pp_lock);
+	kfree(pp->pp_buf);
+	kfree(pp);
+}
+
+static
+int
+pipe_eachopen(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return 0;
+}
+
+/*
+ * The last reference to one end has gone away. Wake up whoever is
+ * waiting at the other end, so they notice.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool last;
+
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_rvnode) {
+		pp->pp_readers = false;
+		cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	}
+	else {
+		KASSERT(v == &pp->pp_wvnode);
+		pp->pp_writers = false;
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+	}
+	last = !pp->pp_readers && !pp->pp_writers;
+	/* before letting go: once we do, the other end may free the pipe */
+	vnode_cleanup(v);
+	lock_release(pp->pp_lock);
+
+	if (last) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Wait for data, then take as much as there is, up to what was asked
+ * for. Returns with nothing at end of file.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	unsigned tail, len;
+	bool wasfull;
+	int result = 0;
+
+	if (v != &pp->pp_rvnode) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_count == 0 && pp->pp_writers) {
+		cv_wait(pp->pp_readcv, pp->pp_lock);
+	}
+
+	while (uio->uio_resid > 0 && pp->pp_count > 0) {
+		/* up to the end of the buffer, at most */
+		tail = (pp->pp_head + PIPE_SIZE - pp->pp_count) % PIPE_SIZE;
+		len = PIPE_SIZE - tail;
+		if (len > pp->pp_count) {
+			len = pp->pp_count;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+
+		result = uiomove(pp->pp_buf + tail, len, uio);
+		if (result) {
+			break;
+		}
+		wasfull = pp->pp_count == PIPE_SIZE;
+		pp->pp_count -= len;
+		if (wasfull) {
+			cv_broadcast(pp->pp_writecv, pp->pp_lock);
+		}
+	}
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+/*
+ * Write everything, waiting for room as needed. If the read end goes
+ * away, fail with EPIPE, unless something was written already.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	size_t origresid = uio->uio_resid;
+	unsigned len;
+	bool wasempty;
+	int result = 0;
+
+	if (v != &pp->pp_wvnode) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readers) {
+			if (uio->uio_resid == origresid) {
+				result = EPIPE;
+			}
+			break;
+		}
+		if (pp->pp_count == PIPE_SIZE) {
+			cv_wait(pp->pp_writecv, pp->pp_lock);
+			continue;
+		}
+
+		/* up to the end of the buffer, at most */
+		len = PIPE_SIZE - pp->pp_head;
+		if (len > PIPE_SIZE - pp->pp_count) {
+			len = PIPE_SIZE - pp->pp_count;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+
+		result = uiomove(pp->pp_buf + pp->pp_head, len, uio);
+		if (result) {
+			break;
+		}
+		wasempty = pp->pp_count == 0;
+		pp->pp_head = (pp->pp_head + len) % PIPE_SIZE;
+		pp->pp_count += len;
+		if (wasempty) {
+			cv_broadcast(pp->pp_readcv, pp->pp_lock);
+		}
+	}
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+	int result;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	result = VOP_GETTYPE(v, &statbuf->st_mode);
+	if (result) {
+		return result;
+	}
+	statbuf->st_mode |= 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_SIZE;
+
+	/* what is waiting to be read */
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_count;
+	lock_release(pp->pp_lock);
+
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *v)
+{
+	(void)v;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+static
+int
+pipe_mmap(struct vnode *v)
+{
+	(void)v;
+	return ENODEV;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = pipe_mmap,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_nosys,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+int
+pipe_create(struct vnode **rv, struct vnode **wv)
+{
+	struct pipe *pp;
+	int result;
+
+	pp = kmalloc(sizeof(struct pipe));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_SIZE);
+	if (pp->pp_buf == NULL) {
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_readcv = cv_create("pipe read");
+	if (pp->pp_readcv == NULL) {
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_writecv = cv_create("pipe write");
+	if (pp->pp_writecv == NULL) {
+		cv_destroy(pp->pp_readcv);
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_head = 0;
+	pp->pp_count = 0;
+	pp->pp_readers = true;
+	pp->pp_writers = true;
+
+	result = vnode_init(&pp->pp_rvnode, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		pipe_destroy(pp);
+		return result;
+	}
+	result = vnode_init(&pp->pp_wvnode, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		vnode_cleanup(&pp->pp_rvnode);
+		pipe_destroy(pp);
+		return result;
+	}
+
+	*rv = &pp->pp_rvnode;
+	*wv = &pp->pp_wvnode;
+	return 0;
+}
@@ -29,15 +29,35 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/mman.h>
 #include <lib.h>
+#include <uio.h>
+#include <vnode.h>
 #include <addrspace.h>
 #include <vm.h>
 #include <proc.h>
+#include <coremap.h>
+#include <pt.h>
+#include <swapfile.h>
+#include <vm_tlb.h>
+#include <pageout.h>
+#include <vmcache.h>
 
 /*
  * Note! If OPT_DUMBVM is set, as is the case until you start the VM
  * assignment, this file is not compiled or linked or in any way
  * used. The cheesy hack versions in dumbvm.c are used instead.
+ *
+ * An address space is a list of regions plus a page table. Regions
+ * say what may be mapped where; the page table says what actually
+ * is. Nothing is allocated for a page until vm_fault sees the first
+ * access to it, and as_copy shares frames copy-on-write instead of
+ * copying them.
+ *
+ * Page table entries of resident pages may be changed by the pageout
+ * code at any time, or cleared when the page cache evicts the page
+ * they map, so code here locks a frame (as_lockpage) before doing
+ * anything with it.
  */
 
 struct addrspace *
@@ -50,40 +70,392 @@ as_create(void)
 		return NULL;
 	}
 
-	/*
-	 * Initialize as needed.
-	 */
+	as->as_pt = pt_create();
+	if (as->as_pt == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	as->as_regions = NULL;
+	as->as_lastregion = NULL;
+	spinlock_init(&as->as_lock);
+	as->as_loading = false;
+	as->as_heap = NULL;
+	as->as_heapend = 0;
+	as->as_stack = NULL;
 
 	return as;
 }
 
+/*
+ * Append a region to the address space.
+ */
+static
+struct vmregion *
+as_addregion(struct addrspace *as, vaddr_t base, size_t npages, int perm)
+{
+	struct vmregion *vr, **p;
+
+	vr = kmalloc(sizeof(struct vmregion));
+	if (vr == NULL) {
+		return NULL;
+	}
+	vr->vr_base = base;
+	vr->vr_npages = npages;
+	vr->vr_perm = perm;
+	vr->vr_flags = 0;
+	vr->vr_vnode = NULL;
+	vr->vr_fileoff = 0;
+	vr->vr_filebase = 0;
+	vr->vr_filesize = 0;
+	vr->vr_as = as;
+	vr->vr_next = NULL;
+	vr->vr_mapnext = NULL;
+
+	for (p = &as->as_regions; *p != NULL; p = &(*p)->vr_next) {
+		/* nothing */
+	}
+	*p = vr;
+	return vr;
+}
+
+/*
+ * Return a region overlapping the range from BASE up to TOP, if any.
+ */
+static
+struct vmregion *
+as_overlap(struct addrspace *as, vaddr_t base, vaddr_t top)
+{
+	struct vmregion *vr;
+
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vr->vr_base < top &&
+		    vr->vr_base + vr->vr_npages * PAGE_SIZE > base) {
+			return vr;
+		}
+	}
+	return NULL;
+}
+
+struct vmregion *
+as_findregion(struct addrspace *as, vaddr_t vaddr)
+{
+	struct vmregion *vr;
+
+	/* Faults tend to come in runs within one region; try it first. */
+	vr = as->as_lastregion;
+	if (vr != NULL && vaddr >= vr->vr_base &&
+	    vaddr < vr->vr_base + vr->vr_npages * PAGE_SIZE) {
+		return vr;
+	}
+
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vaddr >= vr->vr_base &&
+		    vaddr < vr->vr_base + vr->vr_npages * PAGE_SIZE) {
+			as->as_lastregion = vr;
+			return vr;
+		}
+	}
+	return NULL;
+}
+
+paddr_t
+as_lockpage(struct addrspace *as, uint32_t *pte)
+{
+	uint32_t entry;
+	paddr_t paddr;
+
+	while (1) {
+		spinlock_acquire(&as->as_lock);
+		entry = *pte;
+		spinlock_release(&as->as_lock);
+
+		if (!(entry & PTE_PRESENT)) {
+			return 0;
+		}
+		paddr = entry & PTE_FRAME;
+		if (!coremap_page_lock(paddr)) {
+			/* Freed under us; look again. */
+			continue;
+		}
+
+		spinlock_acquire(&as->as_lock);
+		entry = *pte;
+		spinlock_release(&as->as_lock);
+
+		if ((entry & PTE_PRESENT) && (entry & PTE_FRAME) == paddr) {
+			return paddr;
+		}
+		coremap_page_unlock(paddr);
+	}
+}
+
+struct as_copyargs {
+	struct addrspace *ca_old;
+	struct addrspace *ca_new;
+};
+
+/*
+ * Read the swapped-out page at VADDR of AS, whose entry is PTE, back
+ * into a frame of its own.
+ */
+static
+int
+as_swapin(struct addrspace *as, struct vmregion *vr, uint32_t *pte,
+	  vaddr_t vaddr)
+{
+	uint32_t entry;
+	paddr_t paddr;
+	int result;
+
+	paddr = pageout_getupage();
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+
+	/* Only vm_fault, in this process, brings pages in. */
+	spinlock_acquire(&as->as_lock);
+	entry = *pte;
+	spinlock_release(&as->as_lock);
+	KASSERT(entry & PTE_SWAPPED);
+
+	result = swap_in(PTE_SLOT(entry), paddr);
+	if (result) {
+		coremap_page_lock(paddr);
+		coremap_upage_release(paddr, NULL);
+		return result;
+	}
+
+	spinlock_acquire(&as->as_lock);
+	*pte = paddr | PTE_PRESENT | PTE_DIRTY |
+		((vr->vr_perm & VR_W) ? PTE_WRITE : 0);
+	spinlock_release(&as->as_lock);
+
+	swap_free(PTE_SLOT(entry));
+	coremap_upage_setowner(paddr, as, vaddr);
+	return 0;
+}
+
+/*
+ * pt_walk callback for as_copy: map each resident page into the new
+ * address space as well, read-only in both, and let vm_fault make
+ * the private copy when one of them writes to it. Pages in swap
+ * share the swap slot instead. Pages of MAP_SHARED regions stay
+ * writeable; both spaces are meant to see each other's writes, so
+ * they must have the same frame, and one in swap is read back first.
+ */
+static
+int
+as_sharepage(vaddr_t vaddr, uint32_t *pte, void *data)
+{
+	struct as_copyargs *ca = data;
+	struct addrspace *old = ca->ca_old;
+	struct vmregion *vr;
+	uint32_t *newpte;
+	uint32_t entry;
+	paddr_t paddr;
+	int result;
+
+	newpte = pt_lookup(ca->ca_new->as_pt, vaddr, true);
+	if (newpte == NULL) {
+		return ENOMEM;
+	}
+
+	vr = as_findregion(old, vaddr);
+	KASSERT(vr != NULL);
+
+	while ((paddr = as_lockpage(old, pte)) == 0) {
+		/* Not resident, and only we can bring it in. */
+		spinlock_acquire(&old->as_lock);
+		entry = *pte;
+		spinlock_release(&old->as_lock);
+
+		if (entry == 0) {
+			/* Evicted from the page cache meanwhile. */
+			return 0;
+		}
+		KASSERT(entry & PTE_SWAPPED);
+		if ((vr->vr_flags & VR_SHARED) == 0) {
+			swap_share(PTE_SLOT(entry));
+			*newpte = entry;
+			return 0;
+		}
+		result = as_swapin(old, vr, pte, vaddr);
+		if (result) {
+			return result;
+		}
+	}
+
+	coremap_upage_share(paddr, ca->ca_new);
+
+	spinlock_acquire(&old->as_lock);
+	if ((vr->vr_flags & VR_SHARED) == 0) {
+		*pte &= ~PTE_WRITE;
+	}
+	*newpte = *pte;
+	spinlock_release(&old->as_lock);
+
+	coremap_page_unlock(paddr);
+	return 0;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *newas;
+	struct vmregion *vr, *newvr;
+	struct as_copyargs ca;
+	int result;
 
 	newas = as_create();
 	if (newas==NULL) {
 		return ENOMEM;
 	}
 
+	for (vr = old->as_regions; vr != NULL; vr = vr->vr_next) {
+		newvr = as_addregion(newas, vr->vr_base, vr->vr_npages,
+				     vr->vr_perm);
+		if (newvr == NULL) {
+			as_destroy(newas);
+			return ENOMEM;
+		}
+		newvr->vr_flags = vr->vr_flags;
+		if (vr == old->as_heap) {
+			newas->as_heap = newvr;
+		}
+		if (vr == old->as_stack) {
+			newas->as_stack = newvr;
+		}
+		if (vr->vr_vnode != NULL) {
+			VOP_INCREF(vr->vr_vnode);
+			newvr->vr_vnode = vr->vr_vnode;
+			newvr->vr_fileoff = vr->vr_fileoff;
+			newvr->vr_filebase = vr->vr_filebase;
+			newvr->vr_filesize = vr->vr_filesize;
+			if (vr->vr_flags & VR_MAPPED) {
+				vmcache_addmap(newvr);
+			}
+		}
+	}
+	newas->as_heapend = old->as_heapend;
+
+	ca.ca_old = old;
+	ca.ca_new = newas;
+	result = pt_walk(old->as_pt, as_sharepage, &ca);
+
 	/*
-	 * Write this.
+	 * Our TLB may still hold writeable entries for pages that
+	 * are now shared; drop them. Flushing this cpu's TLB is
+	 * enough: as_activate flushes the TLB on every switch, so
+	 * entries for the old space only survive on the cpu that is
+	 * running us right now.
 	 */
+	as_activate();
 
-	(void)old;
+	if (result) {
+		as_destroy(newas);
+		return result;
+	}
 
 	*ret = newas;
 	return 0;
 }
 
+/*
+ * pt_walk callback for as_destroy: release a resident frame (or our
+ * reference to it, if it is shared) or swap slot.
+ */
+static
+int
+as_freepage(vaddr_t vaddr, uint32_t *pte, void *data)
+{
+	struct addrspace *as = data;
+	paddr_t paddr;
+	unsigned slot;
+
+	(void)vaddr;
+
+	paddr = as_lockpage(as, pte);
+	if (paddr == 0 && *pte == 0) {
+		/* Evicted from the page cache meanwhile. */
+		return 0;
+	}
+	if (paddr == 0) {
+		KASSERT(*pte & PTE_SWAPPED);
+		swap_free(PTE_SLOT(*pte));
+		*pte = 0;
+		return 0;
+	}
+
+	if (coremap_upage_refs(paddr) == 1) {
+		slot = coremap_upage_getslot(paddr);
+		if (slot != CM_NOSLOT) {
+			coremap_upage_setslot(paddr, CM_NOSLOT);
+			swap_free(slot);
+		}
+		coremap_upage_setowner(paddr, NULL, 0);
+	}
+
+	spinlock_acquire(&as->as_lock);
+	*pte = 0;
+	spinlock_release(&as->as_lock);
+
+	coremap_upage_release(paddr, as);
+	return 0;
+}
+
+/*
+ * Free the pages of region VR from START up to END, and tell the page
+ * cache about the ones that came from it.
+ */
+static
+void
+as_unmappages(struct addrspace *as, struct vmregion *vr,
+	      vaddr_t start, vaddr_t end)
+{
+	uint32_t *pte;
+	vaddr_t va;
+
+	for (va = start; va < end; va += PAGE_SIZE) {
+		pte = pt_lookup(as->as_pt, va, false);
+		if (pte == NULL || *pte == 0) {
+			continue;
+		}
+		as_freepage(va, pte, as);
+		vm_tlb_shootdown(as, va);
+		if ((vr->vr_flags & VR_MAPPED) && vr->vr_vnode != NULL) {
+			vmcache_release(vr->vr_vnode,
+					vr->vr_fileoff + (va - vr->vr_base));
+		}
+	}
+}
+
 void
 as_destroy(struct addrspace *as)
 {
-	/*
-	 * Clean up as needed.
-	 */
+	struct vmregion *vr;
+
+	/* Mapped file pages go back to the page cache. */
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if ((vr->vr_flags & VR_MAPPED) && vr->vr_vnode != NULL) {
+			as_unmappages(as, vr, vr->vr_base,
+				      vr->vr_base + vr->vr_npages * PAGE_SIZE);
+			vmcache_delmap(vr);
+		}
+	}
+
+	pt_walk(as->as_pt, as_freepage, as);
+	pt_destroy(as->as_pt);
 
+	while (as->as_regions != NULL) {
+		vr = as->as_regions;
+		as->as_regions = vr->vr_next;
+		if (vr->vr_vnode != NULL) {
+			VOP_DECREF(vr->vr_vnode);
+		}
+		kfree(vr);
+	}
+
+	spinlock_cleanup(&as->as_lock);
 	kfree(as);
 }
 
@@ -101,18 +473,15 @@ as_activate(void)
 		return;
 	}
 
-	/*
-	 * Write this.
-	 */
+	vm_tlb_activate(as);
 }
 
 void
 as_deactivate(void)
 {
 	/*
-	 * Write this. For many designs it won't need to actually do
-	 * anything. See proc.c for an explanation of why it (might)
-	 * be needed.
+	 * Nothing to do: as_activate flushes the whole TLB, so
+	 * nothing of the old space survives the next switch.
 	 */
 }
 
@@ -122,61 +491,473 @@ as_deactivate(void)
  * VADDR+MEMSIZE.
  *
  * The READABLE, WRITEABLE, and EXECUTABLE flags are set if read,
- * write, or execute permission should be set on the segment. At the
- * moment, these are ignored. When you write the VM system, you may
- * want to implement them.
+ * write, or execute permission should be set on the segment. Only
+ * write permission is enforced; the MIPS TLB cannot tell reads from
+ * instruction fetches.
  */
 int
 as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
 		 int readable, int writeable, int executable)
 {
+	size_t npages;
+	int perm;
+
+	/* Align the region. First, the base... */
+	memsize += vaddr & ~(vaddr_t)PAGE_FRAME;
+	vaddr &= PAGE_FRAME;
+
+	/* ...and now the length. */
+	memsize = (memsize + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	if (vaddr + memsize > VM_STACKFLOOR ||
+	    vaddr + memsize < vaddr) {
+		return EFAULT;
+	}
+
 	/*
-	 * Write this.
+	 * Permissions are per region, so segments sharing a page would
+	 * leave that page with the permissions of whichever came first.
 	 */
+	if (as_overlap(as, vaddr, vaddr + memsize) != NULL) {
+		return ENOEXEC;
+	}
 
-	(void)as;
-	(void)vaddr;
-	(void)memsize;
-	(void)readable;
-	(void)writeable;
-	(void)executable;
-	return ENOSYS;
+	npages = memsize / PAGE_SIZE;
+	perm = (readable ? VR_R : 0) | (writeable ? VR_W : 0) |
+		(executable ? VR_X : 0);
+
+	if (as_addregion(as, vaddr, npages, perm) == NULL) {
+		return ENOMEM;
+	}
+	return 0;
 }
 
 int
-as_prepare_load(struct addrspace *as)
+as_define_filedata(struct addrspace *as, vaddr_t vaddr, size_t filesize,
+		   struct vnode *v, off_t offset)
 {
-	/*
-	 * Write this.
-	 */
+	struct vmregion *vr;
+
+	KASSERT(as->as_regions != NULL);
+	for (vr = as->as_regions; vr->vr_next != NULL; vr = vr->vr_next) {
+		/* find the last one */
+	}
+
+	if (vaddr < vr->vr_base ||
+	    vaddr + filesize > vr->vr_base + vr->vr_npages * PAGE_SIZE ||
+	    vaddr + filesize < vaddr) {
+		return EFAULT;
+	}
+	if (filesize == 0) {
+		return 0;
+	}
+
+	VOP_INCREF(v);
+	vr->vr_vnode = v;
+	vr->vr_fileoff = offset;
+	vr->vr_filebase = vaddr;
+	vr->vr_filesize = filesize;
+	return 0;
+}
+
+/*
+ * Read in whatever part of the page at VADDR some region's file data
+ * covers. Mapped files are not read here; their pages come from the
+ * page cache.
+ */
+int
+as_fillpage(struct addrspace *as, vaddr_t vaddr, void *kbuf)
+{
+	struct vmregion *vr;
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t start, end;
+	int result;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
 
-	(void)as;
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vr->vr_vnode == NULL || (vr->vr_flags & VR_MAPPED)) {
+			continue;
+		}
+		start = vaddr > vr->vr_filebase ? vaddr : vr->vr_filebase;
+		end = vr->vr_filebase + vr->vr_filesize;
+		if (end > vaddr + PAGE_SIZE) {
+			end = vaddr + PAGE_SIZE;
+		}
+		if (start >= end) {
+			continue;
+		}
+
+		uio_kinit(&iov, &ku, (char *)kbuf + (start - vaddr),
+			  end - start,
+			  vr->vr_fileoff + (start - vr->vr_filebase),
+			  UIO_READ);
+		result = VOP_READ(vr->vr_vnode, &ku);
+		if (result) {
+			return result;
+		}
+		if (ku.uio_resid != 0) {
+			/* short read; problem with executable? */
+			kprintf("ELF: short read on segment - "
+				"file truncated?\n");
+			return ENOEXEC;
+		}
+	}
+	return 0;
+}
+
+int
+as_prepare_load(struct addrspace *as)
+{
+	/* Let load_elf write into read-only segments. */
+	as->as_loading = true;
 	return 0;
 }
 
 int
 as_complete_load(struct addrspace *as)
 {
-	/*
-	 * Write this.
-	 */
+	struct vmregion *vr;
+	vaddr_t top;
+
+	as->as_loading = false;
+
+	/* The heap starts out empty, just past the highest segment. */
+	top = 0;
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vr->vr_base + vr->vr_npages * PAGE_SIZE > top) {
+			top = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		}
+	}
+	as->as_heap = as_addregion(as, top, 0, VR_R | VR_W);
+	if (as->as_heap == NULL) {
+		return ENOMEM;
+	}
+	as->as_heapend = top;
 
-	(void)as;
+	/* Drop the writeable TLB entries made while loading. */
+	as_activate();
 	return 0;
 }
 
 int
-as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak)
+{
+	struct vmregion *heap = as->as_heap, *vr;
+	vaddr_t newend, newtop, oldtop;
+
+	KASSERT(heap != NULL);
+
+	newend = as->as_heapend + amount;
+	if (amount < 0 ? newend > as->as_heapend : newend < as->as_heapend) {
+		/* wrapped around */
+		return amount < 0 ? EINVAL : ENOMEM;
+	}
+	if (newend < heap->vr_base) {
+		return EINVAL;
+	}
+
+	oldtop = heap->vr_base + heap->vr_npages * PAGE_SIZE;
+	newtop = ROUNDUP(newend, PAGE_SIZE);
+	if (newtop < newend) {
+		return ENOMEM;
+	}
+
+	if (newtop > oldtop) {
+		/* Don't grow into anything else. */
+		if (newtop > VM_STACKFLOOR) {
+			return ENOMEM;
+		}
+		for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+			if (vr != heap && vr->vr_npages > 0 &&
+			    vr->vr_base < newtop &&
+			    vr->vr_base + vr->vr_npages * PAGE_SIZE > oldtop) {
+				return ENOMEM;
+			}
+		}
+	}
+
+	*oldbreak = as->as_heapend;
+	as->as_heapend = newend;
+	heap->vr_npages = (newtop - heap->vr_base) / PAGE_SIZE;
+
+	/* Give back the pages we no longer cover. */
+	as_unmappages(as, heap, newtop, oldtop);
+	return 0;
+}
+
+/*
+ * Find LEN bytes of free address space for a mapping: at HINT if that
+ * is free, otherwise as high as possible below the stack, working
+ * down past whatever is in the way. The heap is left room to grow
+ * up to the lowest mapping. Returns 0 if nothing fits.
+ */
+static
+vaddr_t
+as_findspace(struct addrspace *as, vaddr_t hint, size_t len)
 {
+	struct vmregion *vr;
+	vaddr_t top, limit;
+
+	top = VM_STACKFLOOR;
+	limit = PAGE_SIZE;
+	if (as->as_heap != NULL) {
+		limit = as->as_heap->vr_base +
+			as->as_heap->vr_npages * PAGE_SIZE;
+	}
+
+	hint &= PAGE_FRAME;
+	if (hint >= limit && hint + len > hint && hint + len <= top &&
+	    as_overlap(as, hint, hint + len) == NULL) {
+		return hint;
+	}
+
+	while (top >= len && top - len >= limit) {
+		vr = as_overlap(as, top - len, top);
+		if (vr == NULL) {
+			return top - len;
+		}
+		top = vr->vr_base;
+	}
+	return 0;
+}
+
+/*
+ * Shared anonymous memory has nowhere to come from but its frames, so
+ * give the region all of them now: a page first touched after fork
+ * would otherwise be zero-filled separately on each side. Until then
+ * each frame belongs to AS and can be paged out like any other; once
+ * shared by fork it stays put until only one sharer is left (see
+ * coremap_upage_share), since the sharers would not find it again in
+ * swap.
+ */
+static
+int
+as_prefault(struct addrspace *as, struct vmregion *vr)
+{
+	uint32_t *pte;
+	paddr_t paddr;
+	vaddr_t va;
+
+	for (va = vr->vr_base; va < vr->vr_base + vr->vr_npages * PAGE_SIZE;
+	     va += PAGE_SIZE) {
+		pte = pt_lookup(as->as_pt, va, true);
+		if (pte == NULL) {
+			return ENOMEM;
+		}
+		paddr = pageout_getupage();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+
+		spinlock_acquire(&as->as_lock);
+		KASSERT(*pte == 0);
+		*pte = paddr | PTE_PRESENT | PTE_DIRTY |
+			((vr->vr_perm & VR_W) ? PTE_WRITE : 0);
+		spinlock_release(&as->as_lock);
+
+		coremap_upage_setowner(paddr, as, va);
+	}
+	return 0;
+}
+
+int
+as_mmap(struct addrspace *as, vaddr_t addr, size_t len, int prot,
+	int flags, struct vnode *v, off_t offset, vaddr_t *ret)
+{
+	struct vmregion *vr;
+	vaddr_t base;
+	int perm, result;
+
+	KASSERT(((flags & MAP_ANON) != 0) == (v == NULL));
+
+	if (((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0)) {
+		return EINVAL;
+	}
+	if (len == 0 || offset < 0 || offset % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+	len = ROUNDUP(len, PAGE_SIZE);
+	if (len == 0) {
+		/* wrapped around */
+		return ENOMEM;
+	}
+
+	if (v != NULL) {
+		result = VOP_MMAP(v);
+		if (result) {
+			return result;
+		}
+	}
+
+	if (flags & MAP_FIXED) {
+		if ((addr & ~(vaddr_t)PAGE_FRAME) != 0 ||
+		    addr + len < addr || addr + len > VM_STACKFLOOR) {
+			return EINVAL;
+		}
+		/* Replacing existing mappings is not supported. */
+		if (as_overlap(as, addr, addr + len) != NULL) {
+			return EINVAL;
+		}
+		base = addr;
+	}
+	else {
+		base = as_findspace(as, addr, len);
+		if (base == 0) {
+			return ENOMEM;
+		}
+	}
+
+	perm = ((prot & PROT_READ) ? VR_R : 0) |
+		((prot & PROT_WRITE) ? VR_W : 0) |
+		((prot & PROT_EXEC) ? VR_X : 0);
+
+	vr = as_addregion(as, base, len / PAGE_SIZE, perm);
+	if (vr == NULL) {
+		return ENOMEM;
+	}
+	vr->vr_flags = VR_MAPPED | ((flags & MAP_SHARED) ? VR_SHARED : 0);
+	if (v != NULL) {
+		VOP_INCREF(v);
+		vr->vr_vnode = v;
+		vr->vr_fileoff = offset;
+		vmcache_addmap(vr);
+	}
+	else if (flags & MAP_SHARED) {
+		result = as_prefault(as, vr);
+		if (result) {
+			as_munmap(as, base, len);
+			return result;
+		}
+	}
+
+	*ret = base;
+	return 0;
+}
+
+int
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct vmregion *vr, *tail, **p;
+	vaddr_t end, top, start, stop;
+
+	if ((addr & ~(vaddr_t)PAGE_FRAME) != 0 || len == 0) {
+		return EINVAL;
+	}
+	end = ROUNDUP(addr + len, PAGE_SIZE);
+	if (end <= addr || end > USERSPACETOP) {
+		return EINVAL;
+	}
+
 	/*
-	 * Write this.
+	 * Check everything before changing anything: the range may
+	 * only touch mapped regions, and at most one of them can be
+	 * split in two, which needs a new region.
 	 */
+	tail = NULL;
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		top = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (vr->vr_base >= end || top <= addr) {
+			continue;
+		}
+		if ((vr->vr_flags & VR_MAPPED) == 0) {
+			return EINVAL;
+		}
+		if (vr->vr_base < addr && top > end) {
+			tail = kmalloc(sizeof(struct vmregion));
+			if (tail == NULL) {
+				return ENOMEM;
+			}
+		}
+	}
+
+	p = &as->as_regions;
+	while ((vr = *p) != NULL) {
+		top = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (vr->vr_base >= end || top <= addr) {
+			p = &vr->vr_next;
+			continue;
+		}
+		start = vr->vr_base > addr ? vr->vr_base : addr;
+		stop = top < end ? top : end;
+		as_unmappages(as, vr, start, stop);
+
+		if (start == vr->vr_base && stop == top) {
+			/* All of it */
+			*p = vr->vr_next;
+			if (as->as_lastregion == vr) {
+				as->as_lastregion = NULL;
+			}
+			if (vr->vr_vnode != NULL) {
+				vmcache_delmap(vr);
+				VOP_DECREF(vr->vr_vnode);
+			}
+			kfree(vr);
+			continue;
+		}
 
-	(void)as;
+		if (start > vr->vr_base && stop < top) {
+			/* A hole in the middle; the part above moves out. */
+			KASSERT(tail != NULL);
+			*tail = *vr;
+			tail->vr_base = stop;
+			tail->vr_npages = (top - stop) / PAGE_SIZE;
+			tail->vr_fileoff += stop - vr->vr_base;
+			if (tail->vr_vnode != NULL) {
+				VOP_INCREF(tail->vr_vnode);
+				vmcache_addmap(tail);
+			}
+			vr->vr_next = tail;
+			vr->vr_npages = (start - vr->vr_base) / PAGE_SIZE;
+			tail = NULL;
+		}
+		else if (start == vr->vr_base) {
+			/* The front */
+			vr->vr_fileoff += stop - vr->vr_base;
+			vr->vr_base = stop;
+			vr->vr_npages = (top - stop) / PAGE_SIZE;
+		}
+		else {
+			/* The back */
+			vr->vr_npages = (start - vr->vr_base) / PAGE_SIZE;
+		}
+		p = &vr->vr_next;
+	}
+	KASSERT(tail == NULL);
+	return 0;
+}
+
+struct vmregion *
+as_growstack(struct addrspace *as, vaddr_t vaddr)
+{
+	struct vmregion *vr = as->as_stack;
+
+	if (vr == NULL || vaddr >= vr->vr_base ||
+	    vaddr < USERSTACK - VM_STACKMAXPAGES * PAGE_SIZE) {
+		return NULL;
+	}
+
+	/* The pages in between are filled in as they are touched. */
+	vaddr &= PAGE_FRAME;
+	vr->vr_npages += (vr->vr_base - vaddr) / PAGE_SIZE;
+	vr->vr_base = vaddr;
+	return vr;
+}
+
+int
+as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+{
+	/* One page to start with; as_growstack does the rest. */
+	as->as_stack = as_addregion(as, USERSTACK - PAGE_SIZE, 1,
+				    VR_R | VR_W);
+	if (as->as_stack == NULL) {
+		return ENOMEM;
+	}
 
 	/* Initial user-level stack pointer */
 	*stackptr = USERSTACK;
 
 	return 0;
 }
-
@@ -0,0 +1,832 @@
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <coremap.h>
+
+/*
+ * Physical frame allocator.
+ *
+ * Before coremap_bootstrap runs, memory comes straight from
+ * ram_stealmem and can never be given back. Afterwards every frame
+ * from ram_getfirstfree() up to the top of RAM is tracked here, by
+ * the buddy system described in coremap.h.
+ *
+ * Requests that are not a power of two are served from the next
+ * larger block, and the unused tail is given straight back, so the
+ * only waste is the bookkeeping.
+ *
+ * Single pages go through the per-cpu page cache (c_pagecache in
+ * struct cpu). Each cache has a lock of its own, which other cpus
+ * take only when the free lists run dry, so the common case never
+ * touches coremap_lock. A cache lock is always taken before
+ * coremap_lock, never after.
+ *
+ * The owner, swap slot and busy fields of user frames are changed
+ * only under coremap_lock, so that the clock scan can look at them.
+ * Threads waiting for a page lock sleep on coremap_wchan.
+ */
+
+/* Pages moved between a cpu's cache and the free lists at a time. */
+#define CM_BATCH	(CPU_PAGECACHE_MAX / 2)
+
+static struct spinlock coremap_lock = SPINLOCK_INITIALIZER;
+static struct wchan *coremap_wchan;
+
+static struct coremap_entry *coremap;
+static unsigned coremap_nframes;
+static unsigned coremap_firstfree;	/* first frame we manage */
+static bool coremap_active = false;
+static unsigned coremap_clockhand;	/* next frame the clock looks at */
+
+/* Heads of the per-order free lists; -1 if empty. */
+static int cm_freelist[CM_MAXORDER+1];
+
+static struct {
+	unsigned cs_nblocks[CM_MAXORDER+1];	/* free blocks per order */
+	unsigned cs_nfree;		/* free frames on the lists */
+	unsigned cs_refills;		/* cpu cache refills */
+	unsigned cs_drains;		/* cpu cache drains */
+	unsigned cs_steals;		/* pages taken from other cpus' caches */
+	unsigned cs_allocs;		/* multi-page blocks allocated */
+	unsigned cs_frees;		/* multi-page blocks freed */
+	unsigned cs_fails;		/* allocations that found nothing */
+	unsigned cs_splits;		/* blocks split in two */
+	unsigned cs_merges;		/* buddies merged */
+	unsigned cs_nkernel;		/* frames in multi-page kernel blocks */
+	unsigned cs_nshared;		/* user frames with refcount > 1 */
+	unsigned cs_nclean;		/* user frames with a swap slot */
+} cmstats;
+
+/*
+ * Free list handling. Call with coremap_lock held.
+ */
+static
+void
+cm_push(int i, unsigned order)
+{
+	coremap[i].ce_order = order;
+	coremap[i].ce_prev = -1;
+	coremap[i].ce_next = cm_freelist[order];
+	if (cm_freelist[order] >= 0) {
+		coremap[cm_freelist[order]].ce_prev = i;
+	}
+	cm_freelist[order] = i;
+	cmstats.cs_nblocks[order]++;
+}
+
+static
+void
+cm_remove(int i)
+{
+	unsigned order = coremap[i].ce_order;
+
+	KASSERT(order <= CM_MAXORDER);
+	if (coremap[i].ce_prev >= 0) {
+		coremap[coremap[i].ce_prev].ce_next = coremap[i].ce_next;
+	}
+	else {
+		KASSERT(cm_freelist[order] == i);
+		cm_freelist[order] = coremap[i].ce_next;
+	}
+	if (coremap[i].ce_next >= 0) {
+		coremap[coremap[i].ce_next].ce_prev = coremap[i].ce_prev;
+	}
+	coremap[i].ce_order = CM_NOORDER;
+	cmstats.cs_nblocks[order]--;
+}
+
+/*
+ * Return the aligned block of 2^ORDER frames starting at I to the
+ * free lists, merging it with its buddy as far as possible.
+ */
+static
+void
+cm_freeblock(unsigned i, unsigned order)
+{
+	unsigned buddy;
+
+	while (order < CM_MAXORDER) {
+		buddy = i ^ (1U << order);
+		if (buddy >= coremap_nframes ||
+		    coremap[buddy].ce_state != CM_FREE ||
+		    coremap[buddy].ce_order != order) {
+			break;
+		}
+		cm_remove(buddy);
+		i = i < buddy ? i : buddy;
+		order++;
+		cmstats.cs_merges++;
+	}
+	cm_push(i, order);
+}
+
+/*
+ * Free the frames FIRST..FIRST+NPAGES-1, cutting the range into the
+ * largest aligned blocks it contains.
+ */
+static
+void
+cm_freerange(unsigned first, unsigned npages)
+{
+	unsigned i, order;
+
+	for (i=first; i<first+npages; i++) {
+		coremap[i].ce_state = CM_FREE;
+		coremap[i].ce_order = CM_NOORDER;
+		coremap[i].ce_npages = 0;
+		coremap[i].ce_as = NULL;
+		coremap[i].ce_swapslot = CM_NOSLOT;
+		coremap[i].ce_busy = false;
+		coremap[i].ce_used = false;
+		coremap[i].ce_cow = false;
+	}
+	cmstats.cs_nfree += npages;
+
+	while (npages > 0) {
+		order = 0;
+		while (order < CM_MAXORDER &&
+		       (first & ((2U << order) - 1)) == 0 &&
+		       (2U << order) <= npages) {
+			order++;
+		}
+		cm_freeblock(first, order);
+		first += 1U << order;
+		npages -= 1U << order;
+	}
+}
+
+/*
+ * Take NPAGES contiguous frames off the free lists and mark them
+ * STATE. Call with coremap_lock held.
+ */
+static
+paddr_t
+cm_alloc(unsigned npages, unsigned char state)
+{
+	unsigned order, j, i, k;
+	int b;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	order = 0;
+	while ((1U << order) < npages) {
+		order++;
+	}
+	if (order > CM_MAXORDER) {
+		return 0;
+	}
+
+	for (j=order; j<=CM_MAXORDER; j++) {
+		if (cm_freelist[j] >= 0) {
+			break;
+		}
+	}
+	if (j > CM_MAXORDER) {
+		return 0;
+	}
+
+	b = cm_freelist[j];
+	cm_remove(b);
+
+	/* Split down to the order we need, freeing the upper halves. */
+	while (j > order) {
+		j--;
+		cm_push(b + (1 << j), j);
+		cmstats.cs_splits++;
+	}
+
+	i = b;
+	for (k=i; k<i+(1U << order); k++) {
+		coremap[k].ce_state = state;
+		coremap[k].ce_npages = 0;
+	}
+	cmstats.cs_nfree -= 1U << order;
+
+	/* Give back what we don't need. */
+	if (npages < (1U << order)) {
+		cm_freerange(i + npages, (1U << order) - npages);
+	}
+
+	coremap[i].ce_npages = npages;
+	coremap[i].ce_refcount = 1;
+	return (paddr_t)i * PAGE_SIZE;
+}
+
+/*
+ * Move up to NPAGES pages from cpu C's cache back to the free lists.
+ * Call with C's cache lock and coremap_lock held.
+ */
+static
+void
+cm_cache_drain(struct cpu *c, unsigned npages)
+{
+	paddr_t pa;
+
+	KASSERT(spinlock_do_i_hold(&c->c_pagecache_lock));
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	while (npages > 0 && c->c_pagecache_count > 0) {
+		pa = c->c_pagecache[--c->c_pagecache_count];
+		cm_freerange(pa / PAGE_SIZE, 1);
+		npages--;
+	}
+	cmstats.cs_drains++;
+}
+
+/*
+ * Drain every cpu's cache, so that cached pages can merge back into
+ * larger blocks.
+ */
+static
+void
+cm_cache_drainall(void)
+{
+	struct cpu *c;
+	unsigned n;
+
+	for (n=0; n<cpu_count(); n++) {
+		c = cpu_get(n);
+		spinlock_acquire(&c->c_pagecache_lock);
+		spinlock_acquire(&coremap_lock);
+		cm_cache_drain(c, CPU_PAGECACHE_MAX);
+		spinlock_release(&coremap_lock);
+		spinlock_release(&c->c_pagecache_lock);
+	}
+}
+
+/*
+ * Take one page from cpu C's cache and mark it STATE. Returns 0 if
+ * the cache is empty. Call with C's cache lock held.
+ */
+static
+paddr_t
+cm_cache_take(struct cpu *c, unsigned char state)
+{
+	paddr_t pa;
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&c->c_pagecache_lock));
+
+	if (c->c_pagecache_count == 0) {
+		return 0;
+	}
+	pa = c->c_pagecache[--c->c_pagecache_count];
+	i = pa / PAGE_SIZE;
+	KASSERT(coremap[i].ce_state == CM_CACHED);
+	coremap[i].ce_state = state;
+	coremap[i].ce_npages = 1;
+	coremap[i].ce_refcount = 1;
+
+	c->c_pagecache_allocs++;
+	if (state == CM_KERNEL) {
+		c->c_pagecache_nkernel++;
+	}
+	else {
+		c->c_pagecache_nuser++;
+	}
+	return pa;
+}
+
+/*
+ * Put the page at PADDR into cpu C's cache, draining half the cache
+ * first if it is full. Call with C's cache lock held.
+ */
+static
+void
+cm_cache_put(struct cpu *c, paddr_t paddr)
+{
+	KASSERT(spinlock_do_i_hold(&c->c_pagecache_lock));
+
+	if (c->c_pagecache_count == CPU_PAGECACHE_MAX) {
+		spinlock_acquire(&coremap_lock);
+		cm_cache_drain(c, CM_BATCH);
+		spinlock_release(&coremap_lock);
+	}
+	coremap[paddr / PAGE_SIZE].ce_state = CM_CACHED;
+	c->c_pagecache[c->c_pagecache_count++] = paddr;
+	c->c_pagecache_frees++;
+}
+
+/*
+ * Get one page from this cpu's cache and mark it STATE, refilling
+ * the cache from the free lists first if it is empty. If the free
+ * lists are empty too, take a page from another cpu's cache.
+ */
+static
+paddr_t
+cm_cache_get(unsigned char state)
+{
+	struct cpu *c;
+	paddr_t pa;
+	unsigned n;
+	int spl;
+
+	/* No switching to another cpu under us. */
+	spl = splhigh();
+	c = curcpu->c_self;
+	spinlock_acquire(&c->c_pagecache_lock);
+
+	if (c->c_pagecache_count == 0) {
+		spinlock_acquire(&coremap_lock);
+		while (c->c_pagecache_count < CM_BATCH &&
+		       cmstats.cs_nfree > 0) {
+			pa = cm_alloc(1, CM_CACHED);
+			KASSERT(pa != 0);
+			c->c_pagecache[c->c_pagecache_count++] = pa;
+		}
+		cmstats.cs_refills++;
+		spinlock_release(&coremap_lock);
+	}
+
+	pa = cm_cache_take(c, state);
+	spinlock_release(&c->c_pagecache_lock);
+	splx(spl);
+
+	if (pa != 0) {
+		return pa;
+	}
+
+	/* One cache lock at a time, so two cpus here can't deadlock. */
+	for (n=0; n<cpu_count(); n++) {
+		c = cpu_get(n);
+		spinlock_acquire(&c->c_pagecache_lock);
+		pa = cm_cache_take(c, state);
+		spinlock_release(&c->c_pagecache_lock);
+		if (pa != 0) {
+			break;
+		}
+	}
+
+	spinlock_acquire(&coremap_lock);
+	if (pa != 0) {
+		cmstats.cs_steals++;
+	}
+	else {
+		cmstats.cs_fails++;
+	}
+	spinlock_release(&coremap_lock);
+	return pa;
+}
+
+void
+coremap_bootstrap(void)
+{
+	paddr_t top, first;
+	unsigned i, npages;
+
+	spinlock_acquire(&coremap_lock);
+
+	top = ram_getsize();
+	coremap_nframes = top / PAGE_SIZE;
+
+	/* Steal room for the map itself before ram.c gives up memory. */
+	npages = DIVROUNDUP(coremap_nframes * sizeof(struct coremap_entry),
+			    PAGE_SIZE);
+	first = ram_stealmem(npages);
+	if (first == 0) {
+		panic("coremap: cannot allocate %u pages\n", npages);
+	}
+	coremap = (struct coremap_entry *)PADDR_TO_KVADDR(first);
+
+	first = ram_getfirstfree();
+	coremap_firstfree = first / PAGE_SIZE;
+
+	for (i=0; i<=CM_MAXORDER; i++) {
+		cm_freelist[i] = -1;
+	}
+	for (i=0; i<coremap_nframes; i++) {
+		coremap[i].ce_state = CM_FIXED;
+		coremap[i].ce_order = CM_NOORDER;
+		coremap[i].ce_npages = 0;
+		coremap[i].ce_refcount = 0;
+		coremap[i].ce_next = coremap[i].ce_prev = -1;
+		coremap[i].ce_as = NULL;
+		coremap[i].ce_vaddr = 0;
+		coremap[i].ce_sharers = 0;
+		coremap[i].ce_swapslot = CM_NOSLOT;
+		coremap[i].ce_busy = false;
+		coremap[i].ce_used = false;
+		coremap[i].ce_cow = false;
+	}
+	cm_freerange(coremap_firstfree, coremap_nframes - coremap_firstfree);
+	coremap_clockhand = coremap_firstfree;
+
+	coremap_active = true;
+	spinlock_release(&coremap_lock);
+
+	coremap_wchan = wchan_create("coremap");
+	if (coremap_wchan == NULL) {
+		panic("coremap: cannot create wchan\n");
+	}
+}
+
+paddr_t
+coremap_getkpages(unsigned npages)
+{
+	paddr_t pa;
+
+	KASSERT(npages > 0);
+
+	if (coremap_active && npages == 1) {
+		return cm_cache_get(CM_KERNEL);
+	}
+
+	spinlock_acquire(&coremap_lock);
+	if (!coremap_active) {
+		/* Early boot: memory from here is never freed. */
+		pa = ram_stealmem(npages);
+		spinlock_release(&coremap_lock);
+		return pa;
+	}
+	pa = cm_alloc(npages, CM_KERNEL);
+	spinlock_release(&coremap_lock);
+
+	if (pa == 0) {
+		/* Cached pages might close a gap. */
+		cm_cache_drainall();
+		spinlock_acquire(&coremap_lock);
+		pa = cm_alloc(npages, CM_KERNEL);
+		spinlock_release(&coremap_lock);
+	}
+
+	spinlock_acquire(&coremap_lock);
+	if (pa != 0) {
+		cmstats.cs_allocs++;
+		cmstats.cs_nkernel += npages;
+	}
+	else {
+		cmstats.cs_fails++;
+	}
+	spinlock_release(&coremap_lock);
+	return pa;
+}
+
+paddr_t
+coremap_getupage(void)
+{
+	KASSERT(coremap_active);
+	return cm_cache_get(CM_USER);
+}
+
+void
+coremap_freepages(paddr_t paddr)
+{
+	struct cpu *c;
+	unsigned first, npages;
+	int spl;
+
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+	first = paddr / PAGE_SIZE;
+	KASSERT(first < coremap_nframes);
+
+	/* The block is ours, so its entry can be read without the lock. */
+	if (!coremap_active || coremap[first].ce_state == CM_FIXED) {
+		/* Stolen before bootstrap; size unknown, so leak it. */
+		return;
+	}
+	KASSERT(coremap[first].ce_state == CM_KERNEL);
+	npages = coremap[first].ce_npages;
+	KASSERT(npages > 0);
+	coremap[first].ce_refcount = 0;
+
+	if (npages == 1) {
+		spl = splhigh();
+		c = curcpu->c_self;
+		spinlock_acquire(&c->c_pagecache_lock);
+		cm_cache_put(c, paddr);
+		c->c_pagecache_nkernel--;
+		spinlock_release(&c->c_pagecache_lock);
+		splx(spl);
+		return;
+	}
+
+	spinlock_acquire(&coremap_lock);
+	cmstats.cs_frees++;
+	cmstats.cs_nkernel -= npages;
+	cm_freerange(first, npages);
+	spinlock_release(&coremap_lock);
+}
+
+unsigned
+coremap_freecount(void)
+{
+	/* Only a hint, so no lock. */
+	return cmstats.cs_nfree;
+}
+
+bool
+coremap_page_lock(paddr_t paddr)
+{
+	unsigned i = paddr / PAGE_SIZE;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	while (coremap[i].ce_state == CM_USER && coremap[i].ce_busy) {
+		wchan_sleep(coremap_wchan, &coremap_lock);
+	}
+	if (coremap[i].ce_state != CM_USER) {
+		spinlock_release(&coremap_lock);
+		return false;
+	}
+	coremap[i].ce_busy = true;
+	spinlock_release(&coremap_lock);
+	return true;
+}
+
+void
+coremap_page_unlock(paddr_t paddr)
+{
+	unsigned i = paddr / PAGE_SIZE;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].ce_state == CM_USER);
+	KASSERT(coremap[i].ce_busy);
+	coremap[i].ce_busy = false;
+	wchan_wakeall(coremap_wchan, &coremap_lock);
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_upage_release(paddr_t paddr, struct addrspace *as)
+{
+	unsigned i = paddr / PAGE_SIZE;
+	struct cpu *c;
+	bool freed;
+	int spl;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].ce_state == CM_USER);
+	KASSERT(coremap[i].ce_busy);
+	KASSERT(coremap[i].ce_refcount > 0);
+
+	freed = coremap[i].ce_refcount == 1;
+	if (!freed) {
+		coremap[i].ce_refcount--;
+		if (coremap[i].ce_refcount == 1) {
+			cmstats.cs_nshared--;
+		}
+		if (coremap[i].ce_cow && as == NULL) {
+			/* Can't tell who is left any more. */
+			coremap[i].ce_cow = false;
+		}
+		else if (coremap[i].ce_cow) {
+			coremap[i].ce_sharers ^= (uintptr_t)as;
+			if (coremap[i].ce_refcount == 1) {
+				/* The last sharer owns it again. */
+				coremap[i].ce_as =
+					(struct addrspace *)coremap[i].ce_sharers;
+				coremap[i].ce_used = true;
+				coremap[i].ce_cow = false;
+			}
+		}
+	}
+	else {
+		KASSERT(coremap[i].ce_swapslot == CM_NOSLOT);
+		coremap[i].ce_refcount = 0;
+		coremap[i].ce_as = NULL;
+		coremap[i].ce_used = false;
+		coremap[i].ce_cow = false;
+		/* No longer a user page, so nobody can lock it. */
+		coremap[i].ce_state = CM_CACHED;
+	}
+	coremap[i].ce_busy = false;
+	wchan_wakeall(coremap_wchan, &coremap_lock);
+	spinlock_release(&coremap_lock);
+
+	if (freed) {
+		/* The cache lock comes before coremap_lock. */
+		spl = splhigh();
+		c = curcpu->c_self;
+		spinlock_acquire(&c->c_pagecache_lock);
+		cm_cache_put(c, paddr);
+		c->c_pagecache_nuser--;
+		spinlock_release(&c->c_pagecache_lock);
+		splx(spl);
+	}
+}
+
+void
+coremap_upage_share(paddr_t paddr, struct addrspace *as)
+{
+	unsigned i = paddr / PAGE_SIZE;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].ce_state == CM_USER);
+	KASSERT(coremap[i].ce_busy);
+	KASSERT(coremap[i].ce_refcount > 0);
+	/*
+	 * Sharers all map the page at ce_vaddr. Once the page has only
+	 * one left, XORing the others back out of ce_sharers gives it.
+	 */
+	if (coremap[i].ce_as != NULL) {
+		KASSERT(coremap[i].ce_refcount == 1);
+		coremap[i].ce_sharers = (uintptr_t)coremap[i].ce_as;
+		coremap[i].ce_cow = true;
+	}
+	if (as == NULL) {
+		coremap[i].ce_cow = false;
+	}
+	else if (coremap[i].ce_cow) {
+		coremap[i].ce_sharers ^= (uintptr_t)as;
+	}
+	coremap[i].ce_refcount++;
+	if (coremap[i].ce_refcount == 2) {
+		cmstats.cs_nshared++;
+	}
+	coremap[i].ce_as = NULL;
+	spinlock_release(&coremap_lock);
+}
+
+unsigned
+coremap_upage_refs(paddr_t paddr)
+{
+	unsigned i = paddr / PAGE_SIZE;
+	unsigned refs;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].ce_state == CM_USER);
+	refs = coremap[i].ce_refcount;
+	spinlock_release(&coremap_lock);
+	return refs;
+}
+
+void
+coremap_upage_setowner(paddr_t paddr, struct addrspace *as, vaddr_t vaddr)
+{
+	unsigned i = paddr / PAGE_SIZE;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].ce_state == CM_USER);
+	KASSERT(as == NULL || coremap[i].ce_refcount == 1);
+	coremap[i].ce_as = as;
+	coremap[i].ce_vaddr = vaddr;
+	coremap[i].ce_used = true;
+	coremap[i].ce_cow = false;
+	spinlock_release(&coremap_lock);
+}
+
+unsigned
+coremap_upage_getslot(paddr_t paddr)
+{
+	unsigned i = paddr / PAGE_SIZE;
+	unsigned slot;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].ce_state == CM_USER);
+	slot = coremap[i].ce_swapslot;
+	spinlock_release(&coremap_lock);
+	return slot;
+}
+
+void
+coremap_upage_setslot(paddr_t paddr, unsigned slot)
+{
+	unsigned i = paddr / PAGE_SIZE;
+
+	KASSERT(i < coremap_nframes);
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(coremap[i].ce_state == CM_USER);
+	if (coremap[i].ce_swapslot == CM_NOSLOT && slot != CM_NOSLOT) {
+		cmstats.cs_nclean++;
+	}
+	else if (coremap[i].ce_swapslot != CM_NOSLOT && slot == CM_NOSLOT) {
+		cmstats.cs_nclean--;
+	}
+	coremap[i].ce_swapslot = slot;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_upage_touch(paddr_t paddr)
+{
+	unsigned i = paddr / PAGE_SIZE;
+
+	KASSERT(i < coremap_nframes);
+
+	/*
+	 * Called on every TLB refill, so no lock: ce_used is a byte
+	 * of its own and a lost update only costs a second chance.
+	 */
+	coremap[i].ce_used = true;
+}
+
+paddr_t
+coremap_pageout_victim(int want, struct addrspace **as, vaddr_t *vaddr)
+{
+	struct coremap_entry *ce;
+	unsigned n, i;
+	int kind;
+
+	spinlock_acquire(&coremap_lock);
+
+	/* Twice round: the first pass may only clear use bits. */
+	for (n=0; n < 2 * (coremap_nframes - coremap_firstfree); n++) {
+		i = coremap_clockhand;
+		coremap_clockhand = (i + 1 < coremap_nframes) ?
+			i + 1 : coremap_firstfree;
+
+		ce = &coremap[i];
+		if (ce->ce_state != CM_USER || ce->ce_as == NULL ||
+		    ce->ce_busy || ce->ce_refcount != 1) {
+			continue;
+		}
+		if (ce->ce_used) {
+			ce->ce_used = false;
+			continue;
+		}
+		kind = (ce->ce_swapslot != CM_NOSLOT) ?
+			CM_VICTIM_CLEAN : CM_VICTIM_DIRTY;
+		if ((want & kind) == 0) {
+			continue;
+		}
+
+		ce->ce_busy = true;
+		*as = ce->ce_as;
+		*vaddr = ce->ce_vaddr;
+		spinlock_release(&coremap_lock);
+		return (paddr_t)i * PAGE_SIZE;
+	}
+
+	spinlock_release(&coremap_lock);
+	return 0;
+}
+
+void
+coremap_printstats(void)
+{
+	struct cpu *c;
+	unsigned i, nblocks[CM_MAXORDER+1];
+	unsigned nfree, ncached, nshared, nclean;
+	unsigned allocs, frees, fails, splits, merges, refills, drains;
+	unsigned steals;
+	int nkernel, nuser;
+
+	spinlock_acquire(&coremap_lock);
+	for (i=0; i<=CM_MAXORDER; i++) {
+		nblocks[i] = cmstats.cs_nblocks[i];
+	}
+	nfree = cmstats.cs_nfree;
+	nkernel = cmstats.cs_nkernel;
+	nshared = cmstats.cs_nshared;
+	nclean = cmstats.cs_nclean;
+	allocs = cmstats.cs_allocs;
+	frees = cmstats.cs_frees;
+	fails = cmstats.cs_fails;
+	splits = cmstats.cs_splits;
+	merges = cmstats.cs_merges;
+	refills = cmstats.cs_refills;
+	drains = cmstats.cs_drains;
+	steals = cmstats.cs_steals;
+	spinlock_release(&coremap_lock);
+
+	/* Single pages are counted by the cache they went through. */
+	ncached = 0;
+	nuser = 0;
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		spinlock_acquire(&c->c_pagecache_lock);
+		ncached += c->c_pagecache_count;
+		allocs += c->c_pagecache_allocs;
+		frees += c->c_pagecache_frees;
+		nkernel += c->c_pagecache_nkernel;
+		nuser += c->c_pagecache_nuser;
+		spinlock_release(&c->c_pagecache_lock);
+	}
+
+	kprintf("coremap: %u frames managed, %u fixed\n",
+		coremap_nframes - coremap_firstfree, coremap_firstfree);
+	kprintf("coremap: %u free, %u in cpu caches, %d kernel, %d user\n",
+		nfree, ncached, nkernel, nuser);
+	kprintf("coremap: %u user pages shared copy-on-write\n", nshared);
+	kprintf("coremap: %u user pages with a clean copy in swap\n", nclean);
+	kprintf("coremap: %u allocs, %u frees, %u failed\n",
+		allocs, frees, fails);
+	kprintf("coremap: %u splits, %u merges\n", splits, merges);
+	kprintf("coremap: %u cache refills, %u cache drains, %u steals\n",
+		refills, drains, steals);
+	kprintf("coremap: free blocks by order:");
+	for (i=0; i<=CM_MAXORDER; i++) {
+		if (nblocks[i] > 0) {
+			kprintf(" %u:%u", i, nblocks[i]);
+		}
+	}
+	kprintf("\n");
+}
@@ -0,0 +1,301 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <coremap.h>
+#include <pt.h>
+#include <swapfile.h>
+#include <vm_tlb.h>
+#include <pageout.h>
+
+/*
+ * Page replacement and the pageout daemon. See pageout.h.
+ *
+ * A victim comes back from coremap_pageout_victim with its page lock
+ * held. That keeps its owner from freeing, sharing or writing to it,
+ * and keeps the owner's address space from going away, until we are
+ * done with it.
+ */
+
+static struct spinlock pageout_lock = SPINLOCK_INITIALIZER;
+static struct wchan *pageout_wchan;
+static bool pageout_wanted;
+
+static struct {
+	unsigned ps_evictions;		/* pages evicted */
+	unsigned ps_discards;		/* ...that the executable still had */
+	unsigned ps_syncwrites;		/* ...that had to be written first */
+	unsigned ps_daemonwrites;	/* pages written back by the daemon */
+	unsigned ps_wakeups;		/* daemon wakeups */
+} pageoutstats;
+
+/*
+ * Return the page table entry for the locked page PADDR, owned by AS
+ * at VADDR. Call with AS's as_lock held.
+ */
+static
+uint32_t *
+pageout_pte(struct addrspace *as, vaddr_t vaddr, paddr_t paddr)
+{
+	uint32_t *pte;
+
+	KASSERT(spinlock_do_i_hold(&as->as_lock));
+
+	pte = pt_lookup(as->as_pt, vaddr, false);
+	KASSERT(pte != NULL);
+	KASSERT((*pte & PTE_PRESENT) && (*pte & PTE_FRAME) == paddr);
+	return pte;
+}
+
+/*
+ * Write the dirty, locked page PADDR to a new swap slot. The page is
+ * write-protected first, so it cannot change under the write; once
+ * the write is done it is clean.
+ */
+static
+int
+pageout_clean(paddr_t paddr, struct addrspace *as, vaddr_t vaddr)
+{
+	uint32_t *pte;
+	unsigned slot;
+	int result;
+
+	KASSERT(coremap_upage_getslot(paddr) == CM_NOSLOT);
+
+	result = swap_alloc(&slot);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&as->as_lock);
+	pte = pageout_pte(as, vaddr, paddr);
+	*pte &= ~PTE_DIRTY;
+	spinlock_release(&as->as_lock);
+	vm_tlb_shootdown(as, vaddr);
+
+	result = swap_out(paddr, slot);
+	if (result) {
+		spinlock_acquire(&as->as_lock);
+		pte = pageout_pte(as, vaddr, paddr);
+		*pte |= PTE_DIRTY;
+		spinlock_release(&as->as_lock);
+		swap_free(slot);
+		return result;
+	}
+
+	coremap_upage_setslot(paddr, slot);
+	return 0;
+}
+
+/*
+ * Evict the locked page PADDR if it has no copy in swap because it
+ * needs none: a clean page of an executable (see vm_newpage), which
+ * vm_fault reads in again. Returns false, with the page still locked,
+ * if it is dirty.
+ */
+static
+bool
+pageout_discard(paddr_t paddr, struct addrspace *as, vaddr_t vaddr)
+{
+	uint32_t *pte;
+
+	KASSERT(coremap_upage_getslot(paddr) == CM_NOSLOT);
+
+	spinlock_acquire(&as->as_lock);
+	pte = pageout_pte(as, vaddr, paddr);
+	if (*pte & PTE_DIRTY) {
+		spinlock_release(&as->as_lock);
+		return false;
+	}
+	*pte = 0;
+	spinlock_release(&as->as_lock);
+	vm_tlb_shootdown(as, vaddr);
+
+	coremap_upage_setowner(paddr, NULL, 0);
+	coremap_upage_release(paddr, as);
+
+	spinlock_acquire(&pageout_lock);
+	pageoutstats.ps_evictions++;
+	pageoutstats.ps_discards++;
+	spinlock_release(&pageout_lock);
+	return true;
+}
+
+int
+pageout_evict(void)
+{
+	struct addrspace *as;
+	vaddr_t vaddr;
+	paddr_t paddr;
+	uint32_t *pte;
+	unsigned slot;
+	int result;
+
+	if (!swap_enabled()) {
+		return ENOMEM;
+	}
+
+	paddr = coremap_pageout_victim(CM_VICTIM_CLEAN, &as, &vaddr);
+	if (paddr == 0) {
+		/* The daemon is behind; do one ourselves. */
+		pageout_wakeup();
+		paddr = coremap_pageout_victim(CM_VICTIM_ANY, &as, &vaddr);
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		if (coremap_upage_getslot(paddr) == CM_NOSLOT) {
+			if (pageout_discard(paddr, as, vaddr)) {
+				return 0;
+			}
+			result = pageout_clean(paddr, as, vaddr);
+			if (result) {
+				coremap_page_unlock(paddr);
+				return ENOMEM;
+			}
+			spinlock_acquire(&pageout_lock);
+			pageoutstats.ps_syncwrites++;
+			spinlock_release(&pageout_lock);
+		}
+	}
+
+	/* The swap copy is current; point the page table at it. */
+	slot = coremap_upage_getslot(paddr);
+	KASSERT(slot != CM_NOSLOT);
+
+	spinlock_acquire(&as->as_lock);
+	pte = pageout_pte(as, vaddr, paddr);
+	KASSERT((*pte & PTE_DIRTY) == 0);
+	*pte = PTE_MKSWAP(slot);
+	spinlock_release(&as->as_lock);
+	vm_tlb_shootdown(as, vaddr);
+
+	/* The slot now belongs to the page table entry. */
+	coremap_upage_setslot(paddr, CM_NOSLOT);
+	coremap_upage_setowner(paddr, NULL, 0);
+	coremap_upage_release(paddr, as);
+
+	spinlock_acquire(&pageout_lock);
+	pageoutstats.ps_evictions++;
+	spinlock_release(&pageout_lock);
+	return 0;
+}
+
+paddr_t
+pageout_getupage(void)
+{
+	paddr_t pa;
+
+	while ((pa = coremap_getupage()) == 0) {
+		if (pageout_evict()) {
+			return 0;
+		}
+	}
+	if (coremap_freecount() < PAGEOUT_LOWAT) {
+		pageout_wakeup();
+	}
+	return pa;
+}
+
+void
+pageout_wakeup(void)
+{
+	spinlock_acquire(&pageout_lock);
+	if (!pageout_wanted) {
+		pageout_wanted = true;
+		wchan_wakeone(pageout_wchan, &pageout_lock);
+	}
+	spinlock_release(&pageout_lock);
+}
+
+/*
+ * The pageout daemon: sleep until memory runs short, then clean a
+ * batch of dirty pages so that evicting them later costs no I/O.
+ */
+static
+void
+pageout_thread(void *data1, unsigned long data2)
+{
+	struct addrspace *as;
+	vaddr_t vaddr;
+	paddr_t paddr;
+	unsigned i;
+	int result;
+
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		spinlock_acquire(&pageout_lock);
+		while (!pageout_wanted) {
+			wchan_sleep(pageout_wchan, &pageout_lock);
+		}
+		pageout_wanted = false;
+		pageoutstats.ps_wakeups++;
+		spinlock_release(&pageout_lock);
+
+		for (i=0; i<PAGEOUT_BATCH; i++) {
+			paddr = coremap_pageout_victim(CM_VICTIM_DIRTY,
+						       &as, &vaddr);
+			if (paddr == 0) {
+				break;
+			}
+			if (pageout_discard(paddr, as, vaddr)) {
+				/* Nothing to write; it is free now. */
+				continue;
+			}
+			result = pageout_clean(paddr, as, vaddr);
+			coremap_page_unlock(paddr);
+			if (result) {
+				/* Out of swap; nothing more to do. */
+				break;
+			}
+			spinlock_acquire(&pageout_lock);
+			pageoutstats.ps_daemonwrites++;
+			spinlock_release(&pageout_lock);
+		}
+	}
+}
+
+void
+pageout_bootstrap(void)
+{
+	int result;
+
+	pageout_wchan = wchan_create("pageout");
+	if (pageout_wchan == NULL) {
+		panic("pageout: cannot create wchan\n");
+	}
+
+	if (!swap_enabled()) {
+		/* Nothing could ever be paged out; don't bother. */
+		return;
+	}
+
+	result = thread_fork("pageout", NULL, pageout_thread, NULL, 0);
+	if (result) {
+		panic("pageout: thread_fork: %s\n", strerror(result));
+	}
+}
+
+void
+pageout_printstats(void)
+{
+	unsigned evictions, discards, syncwrites, daemonwrites, wakeups;
+
+	spinlock_acquire(&pageout_lock);
+	evictions = pageoutstats.ps_evictions;
+	discards = pageoutstats.ps_discards;
+	syncwrites = pageoutstats.ps_syncwrites;
+	daemonwrites = pageoutstats.ps_daemonwrites;
+	wakeups = pageoutstats.ps_wakeups;
+	spinlock_release(&pageout_lock);
+
+	kprintf("pageout: %u evictions, %u needed a synchronous write, "
+		"%u just dropped\n", evictions, syncwrites, discards);
+	kprintf("pageout: %u pages written back by the daemon "
+		"in %u wakeups\n", daemonwrites, wakeups);
+}
@@ -0,0 +1,91 @@
+#include <types.h>
+#include <lib.h>
+#include <pt.h>
+
+/*
+ * Two-level page table. See pt.h.
+ */
+
+struct pagetable *
+pt_create(void)
+{
+	struct pagetable *pt;
+	unsigned i;
+
+	pt = kmalloc(sizeof(struct pagetable));
+	if (pt == NULL) {
+		return NULL;
+	}
+	for (i=0; i<PT_L1_SIZE; i++) {
+		pt->pt_dir[i] = NULL;
+	}
+	return pt;
+}
+
+void
+pt_destroy(struct pagetable *pt)
+{
+	unsigned i;
+
+	for (i=0; i<PT_L1_SIZE; i++) {
+		if (pt->pt_dir[i] != NULL) {
+			kfree(pt->pt_dir[i]);
+		}
+	}
+	kfree(pt);
+}
+
+uint32_t *
+pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create)
+{
+	uint32_t *l2;
+	unsigned i;
+
+	KASSERT(vaddr < USERSPACETOP);
+
+	l2 = pt->pt_dir[PT_L1_INDEX(vaddr)];
+	if (l2 == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		l2 = kmalloc(PT_L2_SIZE * sizeof(uint32_t));
+		if (l2 == NULL) {
+			return NULL;
+		}
+		for (i=0; i<PT_L2_SIZE; i++) {
+			l2[i] = 0;
+		}
+		pt->pt_dir[PT_L1_INDEX(vaddr)] = l2;
+	}
+	return &l2[PT_L2_INDEX(vaddr)];
+}
+
+int
+pt_walk(struct pagetable *pt,
+	int (*func)(vaddr_t vaddr, uint32_t *pte, void *data),
+	void *data)
+{
+	unsigned i, j;
+	uint32_t *l2;
+	vaddr_t vaddr;
+	int result;
+
+	for (i=0; i<PT_L1_SIZE; i++) {
+		l2 = pt->pt_dir[i];
+		if (l2 == NULL) {
+			continue;
+		}
+		for (j=0; j<PT_L2_SIZE; j++) {
+			if (l2[j] == 0) {
+				continue;
+			}
+			vaddr = ((vaddr_t)i << PT_L1_SHIFT) |
+				((vaddr_t)j << PT_L2_SHIFT);
+			result = func(vaddr, &l2[j], data);
+			if (result) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
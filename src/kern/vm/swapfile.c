@@ -0,0 +1,224 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <pt.h>
+#include <swapfile.h>
+
+/*
+ * Swap slot allocation and I/O. See swapfile.h.
+ *
+ * The bitmap, the reference counts and the statistics are protected
+ * by swap_lock, which is never held across I/O. Reads and writes go
+ * straight to the device vnode; the disk driver serializes them.
+ */
+
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
+
+static struct vnode *swap_vnode;	/* NULL if running without swap */
+static struct bitmap *swap_map;		/* slots in use */
+static unsigned short *swap_refcount;	/* references per slot */
+static unsigned swap_nslots;
+
+static struct {
+	unsigned ss_used;		/* slots allocated */
+	unsigned ss_peak;		/* most slots ever allocated at once */
+	unsigned ss_pageins;		/* pages read from swap */
+	unsigned ss_pageouts;		/* pages written to swap */
+	unsigned ss_full;		/* allocations refused */
+} swapstats;
+
+void
+swap_bootstrap(void)
+{
+	struct stat st;
+	unsigned nslots;
+	int result;
+
+	result = vfs_swapon(SWAP_DEVICE, &swap_vnode);
+	if (result) {
+		kprintf("swap: %s: %s; running without swap\n",
+			SWAP_DEVICE, strerror(result));
+		swap_vnode = NULL;
+		return;
+	}
+
+	result = VOP_STAT(swap_vnode, &st);
+	if (result) {
+		panic("swap: %s: stat: %s\n", SWAP_DEVICE, strerror(result));
+	}
+
+	nslots = st.st_size / PAGE_SIZE;
+	if (nslots > PTE_MAXSLOTS) {
+		nslots = PTE_MAXSLOTS;
+	}
+
+	swap_map = bitmap_create(nslots);
+	swap_refcount = kmalloc(nslots * sizeof(swap_refcount[0]));
+	if (swap_map == NULL || swap_refcount == NULL) {
+		panic("swap: out of memory for %u slots\n", nslots);
+	}
+	swap_nslots = nslots;
+
+	kprintf("swap: %u pages on %s\n", nslots, SWAP_DEVICE);
+}
+
+int
+swap_alloc(unsigned *slot)
+{
+	int result;
+
+	spinlock_acquire(&swap_lock);
+	if (swap_map == NULL) {
+		spinlock_release(&swap_lock);
+		return ENOSPC;
+	}
+	result = bitmap_alloc(swap_map, slot);
+	if (result) {
+		swapstats.ss_full++;
+		spinlock_release(&swap_lock);
+		return result;
+	}
+	swap_refcount[*slot] = 1;
+	swapstats.ss_used++;
+	if (swapstats.ss_used > swapstats.ss_peak) {
+		swapstats.ss_peak = swapstats.ss_used;
+	}
+	spinlock_release(&swap_lock);
+	return 0;
+}
+
+void
+swap_share(unsigned slot)
+{
+	spinlock_acquire(&swap_lock);
+	KASSERT(slot < swap_nslots);
+	KASSERT(swap_refcount[slot] > 0);
+	swap_refcount[slot]++;
+	spinlock_release(&swap_lock);
+}
+
+void
+swap_free(unsigned slot)
+{
+	spinlock_acquire(&swap_lock);
+	KASSERT(slot < swap_nslots);
+	KASSERT(swap_refcount[slot] > 0);
+	if (--swap_refcount[slot] == 0) {
+		bitmap_unmark(swap_map, slot);
+		swapstats.ss_used--;
+	}
+	spinlock_release(&swap_lock);
+}
+
+bool
+swap_enabled(void)
+{
+	return swap_vnode != NULL;
+}
+
+unsigned
+swap_refs(unsigned slot)
+{
+	unsigned refs;
+
+	spinlock_acquire(&swap_lock);
+	KASSERT(slot < swap_nslots);
+	refs = swap_refcount[slot];
+	spinlock_release(&swap_lock);
+	return refs;
+}
+
+/*
+ * Move one page between memory and swap.
+ */
+static
+int
+swap_io(paddr_t paddr, unsigned slot, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(swap_vnode != NULL);
+	KASSERT(slot < swap_nslots);
+
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  (off_t)slot * PAGE_SIZE, rw);
+	if (rw == UIO_READ) {
+		result = VOP_READ(swap_vnode, &ku);
+	}
+	else {
+		result = VOP_WRITE(swap_vnode, &ku);
+	}
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		return EIO;
+	}
+	return 0;
+}
+
+int
+swap_in(unsigned slot, paddr_t paddr)
+{
+	int result;
+
+	result = swap_io(paddr, slot, UIO_READ);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&swap_lock);
+	swapstats.ss_pageins++;
+	spinlock_release(&swap_lock);
+	return 0;
+}
+
+int
+swap_out(paddr_t paddr, unsigned slot)
+{
+	int result;
+
+	result = swap_io(paddr, slot, UIO_WRITE);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&swap_lock);
+	swapstats.ss_pageouts++;
+	spinlock_release(&swap_lock);
+	return 0;
+}
+
+void
+swap_printstats(void)
+{
+	unsigned used, peak, pageins, pageouts, full;
+
+	if (swap_vnode == NULL) {
+		kprintf("swap: not configured\n");
+		return;
+	}
+
+	spinlock_acquire(&swap_lock);
+	used = swapstats.ss_used;
+	peak = swapstats.ss_peak;
+	pageins = swapstats.ss_pageins;
+	pageouts = swapstats.ss_pageouts;
+	full = swapstats.ss_full;
+	spinlock_release(&swap_lock);
+
+	kprintf("swap: %u of %u slots in use, %u at most\n",
+		used, swap_nslots, peak);
+	kprintf("swap: %u page-ins, %u page-outs\n", pageins, pageouts);
+	if (full > 0) {
+		kprintf("swap: ran out of space %u times\n", full);
+	}
+}
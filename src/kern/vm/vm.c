@@ -0,0 +1,421 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <current.h>
+#include <mips/tlb.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <coremap.h>
+#include <pt.h>
+#include <swapfile.h>
+#include <pageout.h>
+#include <vm_tlb.h>
+#include <vmcache.h>
+
+/*
+ * Paged virtual memory.
+ *
+ * Each process has a page table (pt.c) and a list of regions
+ * (addrspace.c); physical frames come from the coremap. Pages are
+ * allocated on the first fault that touches them, and zeroed or read
+ * from the executable as the region says. After
+ * fork, parent and child share frames read-only until one of them
+ * writes (copy-on-write). When memory runs out, pages are evicted to
+ * swap (pageout.c) and read back in on the next fault. Pages of
+ * mapped files come from the page cache (vmcache.c) instead.
+ *
+ * Clean pages (with a valid copy in swap) are entered in the TLB
+ * read-only; the first write to one faults, and the swap copy is
+ * dropped before the write is let through. That way pageout knows
+ * which pages it can evict without writing them.
+ */
+
+void
+vm_bootstrap(void)
+{
+	coremap_bootstrap();
+	swap_bootstrap();
+	pageout_bootstrap();
+	vmcache_bootstrap();
+}
+
+/*
+ * Check if we're in a context that can sleep. Allocating memory may
+ * have to page something out, so assert that doing so is ok.
+ */
+static
+void
+vm_can_sleep(void)
+{
+	if (CURCPU_EXISTS()) {
+		/* must not hold spinlocks */
+		KASSERT(curcpu->c_spinlocks == 0);
+
+		/* must not be in an interrupt handler */
+		KASSERT(curthread->t_in_interrupt == 0);
+	}
+}
+
+/* Allocate/free some kernel-space virtual pages */
+vaddr_t
+alloc_kpages(unsigned npages)
+{
+	paddr_t pa;
+
+	vm_can_sleep();
+	pa = coremap_getkpages(npages);
+	while (pa == 0 && npages == 1) {
+		/* Single pages can be had by evicting a user page. */
+		if (pageout_evict()) {
+			return 0;
+		}
+		pa = coremap_getkpages(npages);
+	}
+	if (pa==0) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(pa);
+}
+
+void
+free_kpages(vaddr_t addr)
+{
+	KASSERT(addr >= MIPS_KSEG0);
+	coremap_freepages(addr - MIPS_KSEG0);
+}
+
+/*
+ * First touch of a page: hand out a zero-filled frame, with whatever
+ * part of it comes from the executable read in. A page of a read-only
+ * segment starts out clean, since it can be read in again.
+ */
+static
+int
+vm_newpage(struct addrspace *as, struct vmregion *vr, uint32_t *pte,
+	   vaddr_t vaddr)
+{
+	paddr_t paddr;
+	int result;
+
+	paddr = pageout_getupage();
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+	bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+
+	result = as_fillpage(as, vaddr, (void *)PADDR_TO_KVADDR(paddr));
+	if (result) {
+		coremap_page_lock(paddr);
+		coremap_upage_release(paddr, NULL);
+		return result;
+	}
+
+	spinlock_acquire(&as->as_lock);
+	KASSERT(*pte == 0);
+	if (vr->vr_perm & VR_W) {
+		*pte = paddr | PTE_PRESENT | PTE_DIRTY | PTE_WRITE;
+	}
+	else if (vr->vr_vnode == NULL) {
+		*pte = paddr | PTE_PRESENT | PTE_DIRTY;
+	}
+	else {
+		*pte = paddr | PTE_PRESENT;
+	}
+	spinlock_release(&as->as_lock);
+
+	coremap_upage_setowner(paddr, as, vaddr);
+	return 0;
+}
+
+/*
+ * First touch of a page of a mapped file: map the page cache's frame.
+ * A shared mapping writes to it directly. A private one gets it
+ * read-only, and as the frame is shared with the cache, the first
+ * write makes a private copy (vm_writefault).
+ */
+static
+int
+vm_cachepage(struct addrspace *as, struct vmregion *vr, uint32_t *pte,
+	     vaddr_t vaddr)
+{
+	paddr_t paddr;
+	off_t offset;
+	bool shared;
+	int result;
+
+	offset = vr->vr_fileoff + (vaddr - vr->vr_base);
+	shared = (vr->vr_flags & VR_SHARED) && (vr->vr_perm & VR_W);
+	result = vmcache_get(vr->vr_vnode, offset, shared, &paddr);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&as->as_lock);
+	KASSERT(*pte == 0);
+	*pte = paddr | PTE_PRESENT | PTE_DIRTY | (shared ? PTE_WRITE : 0);
+	spinlock_release(&as->as_lock);
+	return 0;
+}
+
+/*
+ * Fault on a page in swap: read it back. If nobody else refers to the
+ * swap slot, keep it as the page's clean copy, unless we are about to
+ * write to the page anyway.
+ */
+static
+int
+vm_swapin(struct addrspace *as, struct vmregion *vr, uint32_t *pte,
+	  vaddr_t vaddr, int faulttype)
+{
+	uint32_t entry;
+	paddr_t paddr;
+	unsigned slot;
+	bool keep;
+	int result;
+
+	spinlock_acquire(&as->as_lock);
+	entry = *pte;
+	spinlock_release(&as->as_lock);
+	KASSERT(entry & PTE_SWAPPED);
+	slot = PTE_SLOT(entry);
+
+	paddr = pageout_getupage();
+	if (paddr == 0) {
+		return ENOMEM;
+	}
+	result = swap_in(slot, paddr);
+	if (result) {
+		coremap_page_lock(paddr);
+		coremap_upage_release(paddr, NULL);
+		return result;
+	}
+
+	keep = faulttype == VM_FAULT_READ && swap_refs(slot) == 1;
+
+	spinlock_acquire(&as->as_lock);
+	KASSERT(*pte == entry);
+	*pte = paddr | PTE_PRESENT | (keep ? 0 : PTE_DIRTY) |
+		((vr->vr_perm & VR_W) ? PTE_WRITE : 0);
+	spinlock_release(&as->as_lock);
+
+	if (keep) {
+		coremap_upage_setslot(paddr, slot);
+	}
+	else {
+		swap_free(slot);
+	}
+	coremap_upage_setowner(paddr, as, vaddr);
+	return 0;
+}
+
+/*
+ * Write to a resident page that the page table does not let through
+ * yet. If the page is shared copy-on-write, move to a private copy.
+ * Otherwise the page is ours, or shared on purpose (MAP_SHARED): make
+ * it writeable (if its region is) and dirty, dropping its swap copy,
+ * which is about to go stale.
+ */
+static
+int
+vm_writefault(struct addrspace *as, struct vmregion *vr, uint32_t *pte,
+	      vaddr_t vaddr)
+{
+	paddr_t oldpa, newpa;
+	unsigned slot, refs;
+	uint32_t perm;
+
+	perm = (vr->vr_perm & VR_W) ? PTE_WRITE : 0;
+
+	oldpa = as_lockpage(as, pte);
+	if (oldpa == 0) {
+		/* Paged out meanwhile; fault again. */
+		return 0;
+	}
+
+	refs = coremap_upage_refs(oldpa);
+	if (refs == 1 || (vr->vr_flags & VR_SHARED)) {
+		slot = coremap_upage_getslot(oldpa);
+		coremap_upage_setslot(oldpa, CM_NOSLOT);
+
+		spinlock_acquire(&as->as_lock);
+		*pte |= perm | PTE_DIRTY;
+		spinlock_release(&as->as_lock);
+
+		if (refs == 1) {
+			/* It may have been shared until just now; claim it. */
+			coremap_upage_setowner(oldpa, as, vaddr);
+		}
+		coremap_page_unlock(oldpa);
+
+		if (slot != CM_NOSLOT) {
+			swap_free(slot);
+		}
+		return 0;
+	}
+
+	newpa = pageout_getupage();
+	if (newpa == 0) {
+		coremap_page_unlock(oldpa);
+		return ENOMEM;
+	}
+	memmove((void *)PADDR_TO_KVADDR(newpa),
+		(const void *)PADDR_TO_KVADDR(oldpa), PAGE_SIZE);
+
+	spinlock_acquire(&as->as_lock);
+	*pte = newpa | PTE_PRESENT | PTE_DIRTY | perm;
+	spinlock_release(&as->as_lock);
+
+	coremap_upage_setowner(newpa, as, vaddr);
+	coremap_upage_release(oldpa, as);
+	return 0;
+}
+
+/*
+ * TLB entry for the resident page PTE. Writes are let through only
+ * where the page table says so: shared pages stay read-only until
+ * vm_writefault splits them, and clean pages until it dirties them.
+ * While loading, read-only segments are writeable too.
+ */
+static
+uint32_t
+vm_tlbentry(struct addrspace *as, uint32_t pte)
+{
+	uint32_t elo;
+
+	elo = (pte & PTE_FRAME) | TLBLO_VALID;
+	if ((pte & PTE_DIRTY) && ((pte & PTE_WRITE) || as->as_loading)) {
+		elo |= TLBLO_DIRTY;
+	}
+	return elo;
+}
+
+int
+vm_fault(int faulttype, vaddr_t faultaddress)
+{
+	struct addrspace *as;
+	struct vmregion *vr;
+	uint32_t *pte;
+	uint32_t entry;
+	bool writeable;
+	int result;
+
+	faultaddress &= PAGE_FRAME;
+
+	DEBUG(DB_VM, "vm: fault: 0x%x\n", faultaddress);
+
+	switch (faulttype) {
+	    case VM_FAULT_READONLY:
+	    case VM_FAULT_READ:
+	    case VM_FAULT_WRITE:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	if (curproc == NULL) {
+		/*
+		 * No process. This is probably a kernel fault early
+		 * in boot. Return EFAULT so as to panic instead of
+		 * getting into an infinite faulting loop.
+		 */
+		return EFAULT;
+	}
+
+	as = proc_getas();
+	if (as == NULL) {
+		/*
+		 * No address space set up. This is probably also a
+		 * kernel fault early in boot.
+		 */
+		return EFAULT;
+	}
+
+	/*
+	 * Fast path: if the page is resident and the page table allows
+	 * the access, this is just a TLB refill and the region list
+	 * need not be consulted. Holding as_lock from reading the entry
+	 * until the TLB is loaded keeps pageout from taking the page away
+	 * in between.
+	 */
+	spinlock_acquire(&as->as_lock);
+	pte = pt_lookup(as->as_pt, faultaddress, false);
+	if (pte != NULL && !as->as_loading) {
+		entry = *pte;
+		if ((entry & PTE_PRESENT) &&
+		    (faulttype == VM_FAULT_READ ||
+		     (entry & (PTE_WRITE|PTE_DIRTY)) ==
+		     (PTE_WRITE|PTE_DIRTY))) {
+			vm_tlb_miss(faulttype, true);
+			vm_tlb_load(faultaddress, vm_tlbentry(as, entry));
+			spinlock_release(&as->as_lock);
+			coremap_upage_touch(entry & PTE_FRAME);
+			return 0;
+		}
+	}
+	spinlock_release(&as->as_lock);
+	vm_tlb_miss(faulttype, false);
+
+	vr = as_findregion(as, faultaddress);
+	if (vr == NULL) {
+		vr = as_growstack(as, faultaddress);
+	}
+	if (vr == NULL || vr->vr_perm == 0) {
+		/* (a PROT_NONE mapping) */
+		return EFAULT;
+	}
+	writeable = (vr->vr_perm & VR_W) != 0 || as->as_loading;
+	if (faulttype != VM_FAULT_READ && !writeable) {
+		return EFAULT;
+	}
+
+	pte = pt_lookup(as->as_pt, faultaddress, true);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&as->as_lock);
+	entry = *pte;
+	spinlock_release(&as->as_lock);
+
+	if (entry == 0 && (vr->vr_flags & VR_MAPPED) && vr->vr_vnode != NULL) {
+		result = vm_cachepage(as, vr, pte, faultaddress);
+	}
+	else if (entry == 0) {
+		result = vm_newpage(as, vr, pte, faultaddress);
+	}
+	else if (entry & PTE_SWAPPED) {
+		result = vm_swapin(as, vr, pte, faultaddress, faulttype);
+	}
+	else if (faulttype != VM_FAULT_READ &&
+		 (entry & (PTE_WRITE|PTE_DIRTY)) != (PTE_WRITE|PTE_DIRTY) &&
+		 ((vr->vr_perm & VR_W) || !(entry & PTE_DIRTY))) {
+		result = vm_writefault(as, vr, pte, faultaddress);
+	}
+	else {
+		result = 0;
+	}
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Load the translation, unless pageout took the page away
+	 * again meanwhile; then the access just faults once more.
+	 */
+	spinlock_acquire(&as->as_lock);
+	entry = *pte;
+	if (entry & PTE_PRESENT) {
+		DEBUG(DB_VM, "vm: 0x%x -> 0x%x\n", faultaddress,
+		      entry & PTE_FRAME);
+		vm_tlb_load(faultaddress, vm_tlbentry(as, entry));
+	}
+	spinlock_release(&as->as_lock);
+	if (entry & PTE_PRESENT) {
+		coremap_upage_touch(entry & PTE_FRAME);
+	}
+
+	return 0;
+}
@@ -0,0 +1,244 @@
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
+#include <membar.h>
+#include <platform/maxcpus.h>
+#include <mips/tlb.h>
+#include <vm_tlb.h>
+
+/*
+ * TLB replacement and statistics. See vm_tlb.h.
+ *
+ * Apart from shootdowns, everything here touches only the current
+ * cpu's TLB and struct cpu, so disabling interrupts is all the
+ * synchronization needed.
+ *
+ * A shootdown only goes to the cpus whose c_tlb_as is the address
+ * space concerned; no other TLB can hold its translations, since
+ * loading an address space flushes the TLB. The sender changes the
+ * page table before looking at c_tlb_as, and a cpu sets c_tlb_as
+ * before it can fault in anything from the page table, each with a
+ * barrier in between. So a cpu the sender skips can only ever see the
+ * new page table entry.
+ */
+
+void
+vm_tlb_flush(void)
+{
+	int i, spl;
+
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	curcpu->c_tlb_victim = 0;
+	curcpu->c_tlb_filled = 0;
+	curcpu->c_tlb_hole = -1;
+	splx(spl);
+}
+
+void
+vm_tlb_activate(struct addrspace *as)
+{
+	int spl;
+
+	spl = splhigh();
+	vm_tlb_flush();
+	curcpu->c_tlb_as = as;
+	splx(spl);
+	membar_any_any();
+}
+
+/*
+ * Invalidate the entry for VADDR in this cpu's TLB, if there is one.
+ */
+static
+void
+vm_tlb_invalidate(vaddr_t vaddr)
+{
+	int i, spl;
+
+	spl = splhigh();
+	i = tlb_probe(vaddr & PAGE_FRAME, 0);
+	if (i >= 0) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		curcpu->c_tlb_hole = i;
+	}
+	splx(spl);
+}
+
+/*
+ * Called on each target cpu from interprocessor_interrupt.
+ */
+void
+vm_tlbshootdown(const struct tlbshootdown *ts)
+{
+	vm_tlb_invalidate(ts->ts_vaddr);
+}
+
+/*
+ * Called instead when more requests came in than the queue holds.
+ */
+void
+vm_tlbshootdown_all(void)
+{
+	vm_tlb_flush();
+}
+
+/*
+ * Return true once TARGET has handled the shootdowns batch GEN.
+ */
+static
+bool
+vm_tlb_shootdown_done(struct cpu *target, unsigned gen)
+{
+	bool done;
+
+	spinlock_acquire(&target->c_ipi_lock);
+	done = (int)(target->c_shootdown_gen - gen) >= 0;
+	spinlock_release(&target->c_ipi_lock);
+	return done;
+}
+
+void
+vm_tlb_shootdown(struct addrspace *as, vaddr_t vaddr)
+{
+	struct tlbshootdown ts;
+	struct cpu *targets[MAXCPUS];
+	unsigned gens[MAXCPUS];
+	struct cpu *c;
+	unsigned i, n;
+	int spl;
+
+	KASSERT(cpu_count() <= MAXCPUS);
+
+	ts.ts_vaddr = vaddr;
+
+	/* The page table change must be seen before c_tlb_as is read. */
+	membar_any_any();
+
+	/*
+	 * Stay on this cpu until the requests are out, so the one we
+	 * skip really is the one we invalidated ourselves.
+	 */
+	spl = splhigh();
+	vm_tlb_invalidate(vaddr);
+	n = 0;
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		if (c == curcpu->c_self || c->c_tlb_as != as) {
+			continue;
+		}
+		targets[n] = c;
+		gens[n] = ipi_tlbshootdown(c, &ts);
+		n++;
+	}
+	splx(spl);
+
+	/*
+	 * Wait with interrupts on, in case one of the targets is
+	 * waiting for us the same way. The handlers take very little
+	 * time; just spin.
+	 */
+	for (i=0; i<n; i++) {
+		while (!vm_tlb_shootdown_done(targets[i], gens[i])) {
+			/* spin */
+		}
+	}
+}
+
+#if !VM_TLB_RANDOM
+/*
+ * Pick the slot to load into. After a flush the slots are handed out
+ * in order, so everything from c_tlb_filled up is known to be empty.
+ * Past that, reuse the last slot a shootdown emptied, if any, or else
+ * take the victim and advance the pointer. No scanning either way.
+ */
+static
+unsigned
+vm_tlb_victim(void)
+{
+	uint32_t ehi, elo;
+	unsigned slot;
+
+	if (curcpu->c_tlb_filled < NUM_TLB) {
+		return curcpu->c_tlb_filled++;
+	}
+	if (curcpu->c_tlb_hole >= 0) {
+		slot = curcpu->c_tlb_hole;
+		curcpu->c_tlb_hole = -1;
+		return slot;
+	}
+
+	slot = curcpu->c_tlb_victim;
+	curcpu->c_tlb_victim = (slot + 1) % NUM_TLB;
+	tlb_read(&ehi, &elo, slot);
+	if (elo & TLBLO_VALID) {
+		curcpu->c_tlb_evictions++;
+	}
+	return slot;
+}
+#endif
+
+void
+vm_tlb_load(uint32_t ehi, uint32_t elo)
+{
+	int i, spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	i = tlb_probe(ehi, 0);
+	if (i >= 0) {
+		tlb_write(ehi, elo, i);
+		splx(spl);
+		return;
+	}
+
+#if VM_TLB_RANDOM
+	/* We can't tell whether the random slot held anything. */
+	curcpu->c_tlb_evictions++;
+	tlb_random(ehi, elo);
+#else
+	tlb_write(ehi, elo, vm_tlb_victim());
+#endif
+	splx(spl);
+}
+
+void
+vm_tlb_miss(int faulttype, bool refill)
+{
+	int spl;
+
+	spl = splhigh();
+	if (faulttype == VM_FAULT_READONLY) {
+		curcpu->c_tlb_readonly++;
+	}
+	else {
+		curcpu->c_tlb_misses++;
+		if (refill) {
+			curcpu->c_tlb_refills++;
+		}
+	}
+	splx(spl);
+}
+
+void
+vm_tlb_printstats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	kprintf("TLB replacement: %s\n",
+		VM_TLB_RANDOM ? "random" : "round-robin");
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		kprintf("cpu%u: %u misses, %u refills, %u read-only faults, "
+			"%u evictions\n",
+			c->c_number, c->c_tlb_misses, c->c_tlb_refills,
+			c->c_tlb_readonly, c->c_tlb_evictions);
+	}
+}
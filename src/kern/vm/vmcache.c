@@ -0,0 +1,394 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <coremap.h>
+#include <pt.h>
+#include <pageout.h>
+#include <vm_tlb.h>
+#include <vmcache.h>
+
+/*
+ * Page cache for mapped files. See vmcache.h.
+ *
+ * Everything is protected by vmcache_lock, which is held across the
+ * reads and writes so that two processes faulting on the same page
+ * do not both read it in. It is taken before any page lock. That
+ * includes the list of regions mapping files, though the fields of a
+ * region may change under us; eviction checks what it finds against
+ * the page table.
+ */
+
+struct vmcache_entry {
+	struct vnode *vc_vnode;		/* file */
+	off_t vc_offset;		/* page offset in the file */
+	paddr_t vc_paddr;		/* frame holding the page */
+	bool vc_dirty;			/* may have been written */
+	struct vmcache_entry *vc_next;	/* hash chain */
+};
+
+static struct lock *vmcache_lock;
+static struct vmcache_entry *vmcache_hash[VMCACHE_HASHSIZE];
+static struct vmregion *vmcache_maps;	/* regions mapping files */
+static unsigned vmcache_maxpages;
+static unsigned vmcache_hand;		/* next chain to evict from */
+
+static struct {
+	unsigned vs_pages;		/* pages cached */
+	unsigned vs_hits;		/* faults finding the page cached */
+	unsigned vs_misses;		/* ...and having to read it */
+	unsigned vs_writebacks;		/* pages written back to files */
+	unsigned vs_evictions;		/* pages evicted to stay in bounds */
+} vmcachestats;
+
+void
+vmcache_bootstrap(void)
+{
+	vmcache_lock = lock_create("vmcache");
+	if (vmcache_lock == NULL) {
+		panic("vmcache: lock_create failed\n");
+	}
+	vmcache_maxpages = coremap_freecount() / VMCACHE_MEMSHARE;
+}
+
+void
+vmcache_addmap(struct vmregion *vr)
+{
+	KASSERT(vr->vr_vnode != NULL);
+
+	lock_acquire(vmcache_lock);
+	vr->vr_mapnext = vmcache_maps;
+	vmcache_maps = vr;
+	lock_release(vmcache_lock);
+}
+
+void
+vmcache_delmap(struct vmregion *vr)
+{
+	struct vmregion **p;
+
+	lock_acquire(vmcache_lock);
+	for (p = &vmcache_maps; *p != NULL; p = &(*p)->vr_mapnext) {
+		if (*p == vr) {
+			*p = vr->vr_mapnext;
+			break;
+		}
+	}
+	lock_release(vmcache_lock);
+}
+
+static
+unsigned
+vmcache_hashfunc(struct vnode *v, off_t offset)
+{
+	return ((uintptr_t)v / sizeof(struct vnode) +
+		(unsigned)(offset / PAGE_SIZE)) % VMCACHE_HASHSIZE;
+}
+
+/*
+ * Find the entry for V at OFFSET. Returns the link pointing at it (so
+ * it can be unlinked), or the link at the end of the chain.
+ */
+static
+struct vmcache_entry **
+vmcache_find(struct vnode *v, off_t offset)
+{
+	struct vmcache_entry **p;
+
+	KASSERT(lock_do_i_hold(vmcache_lock));
+
+	for (p = &vmcache_hash[vmcache_hashfunc(v, offset)]; *p != NULL;
+	     p = &(*p)->vc_next) {
+		if ((*p)->vc_vnode == v && (*p)->vc_offset == offset) {
+			break;
+		}
+	}
+	return p;
+}
+
+/*
+ * Read the page of V at OFFSET into the frame at PADDR. Whatever lies
+ * past the end of the file reads as zeros.
+ */
+static
+int
+vmcache_readpage(struct vnode *v, off_t offset, paddr_t paddr)
+{
+	struct iovec iov;
+	struct uio ku;
+
+	bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  offset, UIO_READ);
+	return VOP_READ(v, &ku);
+}
+
+/*
+ * Write the frame at PADDR back to the page of V at OFFSET. Mapping a
+ * file does not make it longer, so stop at its end.
+ */
+static
+int
+vmcache_writepage(struct vnode *v, off_t offset, paddr_t paddr)
+{
+	struct iovec iov;
+	struct uio ku;
+	struct stat st;
+	size_t len;
+	int result;
+
+	result = VOP_STAT(v, &st);
+	if (result) {
+		return result;
+	}
+	if (st.st_size <= offset) {
+		return 0;
+	}
+	len = st.st_size - offset < PAGE_SIZE ? st.st_size - offset : PAGE_SIZE;
+
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(paddr), len,
+		  offset, UIO_WRITE);
+	return VOP_WRITE(v, &ku);
+}
+
+/*
+ * Call FUNC on each page table entry that maps the locked frame of VC,
+ * and return how many there were.
+ */
+static
+unsigned
+vmcache_mappings(struct vmcache_entry *vc,
+		 void (*func)(struct addrspace *, vaddr_t, uint32_t *))
+{
+	struct vmregion *vr;
+	struct addrspace *as;
+	uint32_t *pte;
+	vaddr_t vaddr;
+	off_t start;
+	unsigned n;
+	bool found;
+
+	n = 0;
+	for (vr = vmcache_maps; vr != NULL; vr = vr->vr_mapnext) {
+		start = vr->vr_fileoff;
+		if (vr->vr_vnode != vc->vc_vnode || vc->vc_offset < start ||
+		    vc->vc_offset - start >= (off_t)vr->vr_npages * PAGE_SIZE) {
+			continue;
+		}
+		as = vr->vr_as;
+		vaddr = vr->vr_base + (vaddr_t)(vc->vc_offset - start);
+		pte = pt_lookup(as->as_pt, vaddr, false);
+		if (pte == NULL) {
+			continue;
+		}
+
+		spinlock_acquire(&as->as_lock);
+		found = (*pte & PTE_PRESENT) &&
+			(*pte & PTE_FRAME) == vc->vc_paddr;
+		spinlock_release(&as->as_lock);
+
+		if (found) {
+			if (func != NULL) {
+				func(as, vaddr, pte);
+			}
+			n++;
+		}
+	}
+	return n;
+}
+
+static
+void
+vmcache_unmap(struct addrspace *as, vaddr_t vaddr, uint32_t *pte)
+{
+	spinlock_acquire(&as->as_lock);
+	*pte = 0;
+	spinlock_release(&as->as_lock);
+	vm_tlb_shootdown(as, vaddr);
+}
+
+/*
+ * Make room in the cache by evicting a page: take it away from
+ * everyone mapping it (they fault it back in through the cache),
+ * write it back if need be, and free it. Gives up on a page whose
+ * mappings cannot all be found, such as one a process is still
+ * forking with. Returns false if no page could be evicted.
+ */
+static
+bool
+vmcache_evict(void)
+{
+	struct vmcache_entry **p, *vc;
+	unsigned i, refs, n;
+	paddr_t pa;
+	int result;
+
+	KASSERT(lock_do_i_hold(vmcache_lock));
+
+	for (i=0; i<VMCACHE_HASHSIZE; i++) {
+		p = &vmcache_hash[vmcache_hand];
+		vmcache_hand = (vmcache_hand + 1) % VMCACHE_HASHSIZE;
+		for (; (vc = *p) != NULL; p = &vc->vc_next) {
+			pa = vc->vc_paddr;
+			coremap_page_lock(pa);
+			refs = coremap_upage_refs(pa);
+			if (vmcache_mappings(vc, NULL) == refs - 1) {
+				break;
+			}
+			coremap_page_unlock(pa);
+		}
+		if (vc != NULL) {
+			break;
+		}
+	}
+	if (vc == NULL) {
+		return false;
+	}
+
+	n = vmcache_mappings(vc, vmcache_unmap);
+	KASSERT(n == refs - 1);
+	*p = vc->vc_next;
+	vmcachestats.vs_pages--;
+	vmcachestats.vs_evictions++;
+
+	if (vc->vc_dirty) {
+		result = vmcache_writepage(vc->vc_vnode, vc->vc_offset, pa);
+		if (result) {
+			kprintf("vmcache: writeback at offset %llu: %s\n",
+				(unsigned long long)vc->vc_offset,
+				strerror(result));
+		}
+		vmcachestats.vs_writebacks++;
+	}
+
+	/* Drop the mappings' references, then our own. */
+	for (i=0; i<n; i++) {
+		coremap_upage_release(pa, NULL);
+		coremap_page_lock(pa);
+	}
+	coremap_upage_release(pa, NULL);
+	VOP_DECREF(vc->vc_vnode);
+	kfree(vc);
+	return true;
+}
+
+int
+vmcache_get(struct vnode *v, off_t offset, bool write, paddr_t *paddr)
+{
+	struct vmcache_entry **p, *vc;
+	paddr_t pa;
+	int result;
+
+	KASSERT(offset % PAGE_SIZE == 0);
+
+	lock_acquire(vmcache_lock);
+
+	p = vmcache_find(v, offset);
+	vc = *p;
+	if (vc != NULL) {
+		vmcachestats.vs_hits++;
+	}
+	else {
+		if (vmcachestats.vs_pages >= vmcache_maxpages &&
+		    !vmcache_evict()) {
+			lock_release(vmcache_lock);
+			return ENOMEM;
+		}
+		/* Eviction may have changed the chain. */
+		p = vmcache_find(v, offset);
+
+		vc = kmalloc(sizeof(struct vmcache_entry));
+		if (vc == NULL) {
+			lock_release(vmcache_lock);
+			return ENOMEM;
+		}
+		pa = pageout_getupage();
+		if (pa == 0) {
+			kfree(vc);
+			lock_release(vmcache_lock);
+			return ENOMEM;
+		}
+		result = vmcache_readpage(v, offset, pa);
+		if (result) {
+			coremap_page_lock(pa);
+			coremap_upage_release(pa, NULL);
+			kfree(vc);
+			lock_release(vmcache_lock);
+			return result;
+		}
+
+		VOP_INCREF(v);
+		vc->vc_vnode = v;
+		vc->vc_offset = offset;
+		vc->vc_paddr = pa;
+		vc->vc_dirty = false;
+		vc->vc_next = NULL;
+		*p = vc;
+
+		vmcachestats.vs_pages++;
+		vmcachestats.vs_misses++;
+	}
+
+	/* One reference for the caller's mapping. */
+	coremap_page_lock(vc->vc_paddr);
+	coremap_upage_share(vc->vc_paddr, NULL);
+	coremap_page_unlock(vc->vc_paddr);
+
+	if (write) {
+		vc->vc_dirty = true;
+	}
+	*paddr = vc->vc_paddr;
+
+	lock_release(vmcache_lock);
+	return 0;
+}
+
+void
+vmcache_release(struct vnode *v, off_t offset)
+{
+	struct vmcache_entry **p, *vc;
+	int result;
+
+	lock_acquire(vmcache_lock);
+
+	p = vmcache_find(v, offset);
+	vc = *p;
+	if (vc == NULL || coremap_upage_refs(vc->vc_paddr) > 1) {
+		lock_release(vmcache_lock);
+		return;
+	}
+	*p = vc->vc_next;
+	vmcachestats.vs_pages--;
+
+	if (vc->vc_dirty) {
+		result = vmcache_writepage(v, offset, vc->vc_paddr);
+		if (result) {
+			kprintf("vmcache: writeback at offset %llu: %s\n",
+				(unsigned long long)offset, strerror(result));
+		}
+		vmcachestats.vs_writebacks++;
+	}
+
+	lock_release(vmcache_lock);
+
+	coremap_page_lock(vc->vc_paddr);
+	coremap_upage_release(vc->vc_paddr, NULL);
+	VOP_DECREF(vc->vc_vnode);
+	kfree(vc);
+}
+
+void
+vmcache_printstats(void)
+{
+	lock_acquire(vmcache_lock);
+	kprintf("vmcache: %u pages cached (at most %u), %u hits, "
+		"%u misses, %u writebacks, %u evictions\n",
+		vmcachestats.vs_pages, vmcache_maxpages, vmcachestats.vs_hits,
+		vmcachestats.vs_misses, vmcachestats.vs_writebacks,
+		vmcachestats.vs_evictions);
+	lock_release(vmcache_lock);
+}
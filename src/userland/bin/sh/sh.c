@@ -476,14 +476,70 @@ docommand(char *buf, struct exitinfo *ei)
 
 /*
  * getcmd
- * pulls valid characters off the console, filling the buffer.
- * backspace deletes a character, simply by moving the position back.
- * a newline or carriage return breaks the loop, which terminates
- * the string and returns.
+ * reads a command line from the console into the buffer.
  *
- * if there's an invalid character or a backspace when there's nothing
- * in the buffer, putchars an alert (bell).
+ * On OS/161 the console is put in canonical mode while we read, so
+ * the driver collects the line itself, handling echo and backspace,
+ * and read returns it whole with the newline; the newline is dropped
+ * and the string terminated. End of file (^D on an empty line) exits
+ * the shell. The console goes back to raw mode afterwards, which is
+ * what the programs we run expect. (If stdin is not the console, the
+ * ioctl fails and does no harm.)
+ *
+ * On the host the terminal is in raw mode (see hostcompat), so
+ * characters are pulled off one at a time: backspace deletes a
+ * character, simply by moving the position back; a newline or
+ * carriage return breaks the loop, which terminates the string and
+ * returns. If there's an invalid character or a backspace when
+ * there's nothing in the buffer, putchars an alert (bell).
  */
+#ifndef HOST
+static
+void
+setcanon(int on)
+{
+	ioctl(STDIN_FILENO, IOCTL_CON_SETCANON, &on);
+}
+
+static
+void
+getcmd(char *buf, size_t len)
+{
+	ssize_t r;
+	size_t pos = 0;
+	char junk;
+
+	setcanon(1);
+	while (pos == 0 || buf[pos-1] != '\n') {
+		r = read(STDIN_FILENO, buf + pos, len - 1 - pos);
+		if (r < 0) {
+			setcanon(0);
+			err(1, "stdin");
+		}
+		if (r == 0) {
+			if (pos == 0) {
+				setcanon(0);
+				exit(0);
+			}
+			break;
+		}
+		pos += r;
+		if (pos == len - 1 && buf[pos-1] != '\n') {
+			/* too long; truncate, discarding the rest */
+			while (read(STDIN_FILENO, &junk, 1) == 1 &&
+			       junk != '\n') {
+				/* nothing */
+			}
+			break;
+		}
+	}
+	setcanon(0);
+	if (pos > 0 && buf[pos-1] == '\n') {
+		pos--;
+	}
+	buf[pos] = 0;
+}
+#else
 static
 void
 getcmd(char *buf, size_t len)
@@ -519,6 +575,7 @@ getcmd(char *buf, size_t len)
 	}
 	buf[pos] = 0;
 }
+#endif
 
 /*
  * interactive
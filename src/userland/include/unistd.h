@@ -40,12 +40,19 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/mman.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/sysstat.h>
 #include <kern/time.h>
+#include <kern/resource.h>	/* uses struct timeval */
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
+/* Returned by mmap() on failure. */
+#define MAP_FAILED ((void *)-1)
+
 
 /*
  * Prototypes for OS/161 system calls.
@@ -121,6 +128,13 @@ pid_t waitpid(pid_t pid, int *returncode, int flags);
 int open(const char *filename, int flags, ...);
 ssize_t read(int filehandle, void *buf, size_t size);
 ssize_t write(int filehandle, const void *buf, size_t size);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t preadv(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
+ssize_t pwritev(int filehandle, const struct iovec *iov, int iovcnt,
+		off_t pos);
 int close(int filehandle);
 int reboot(int code);
 int sync(void);
@@ -141,12 +155,19 @@ int chdir(const char *path);
 
 /* Optional. */
 void *sbrk(__intptr_t change);
+void *mmap(void *addr, size_t len, int prot, int flags, int filehandle,
+	   off_t offset);
+int munmap(void *addr, size_t len);
 ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+int getpriority(int which, pid_t who);
+int setpriority(int which, pid_t who, int prio);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int __sysstat(struct sysstat *stats, int count);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -0,0 +1,55 @@
+/*
+ * sysstat - print system call statistics.
+ * Usage: sysstat [-a]
+ *
+ * Prints, for each system call made since boot, how many times it
+ * has been called and the total and average time spent in it. With
+ * -a, also lists the calls that have not been made.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+/* More than there are call numbers. */
+#define MAXSTATS 128
+
+static struct sysstat stats[MAXSTATS];
+
+int
+main(int argc, char *argv[])
+{
+	int all = 0;
+	int i, n;
+
+	if (argc == 2 && !strcmp(argv[1], "-a")) {
+		all = 1;
+	}
+	else if (argc != 1) {
+		errx(1, "Usage: sysstat [-a]");
+	}
+
+	n = __sysstat(stats, MAXSTATS);
+	if (n < 0) {
+		err(1, "__sysstat");
+	}
+
+	printf("%-12s %4s %10s %14s %10s\n", "syscall", "num", "calls",
+	       "total ns", "avg ns");
+	for (i=0; i<n; i++) {
+		if (stats[i].ss_calls == 0) {
+			if (all) {
+				printf("%-12s %4d %10u\n", stats[i].ss_name,
+				       stats[i].ss_callno, 0);
+			}
+			continue;
+		}
+		printf("%-12s %4d %10u %14llu %10llu\n", stats[i].ss_name,
+		       stats[i].ss_callno, stats[i].ss_calls,
+		       (unsigned long long)stats[i].ss_nsecs,
+		       (unsigned long long)(stats[i].ss_nsecs /
+					    stats[i].ss_calls));
+	}
+	return 0;
+}
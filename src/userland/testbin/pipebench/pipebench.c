@@ -0,0 +1,242 @@
+/*
+ * pipebench - measure pipe throughput.
+ *
+ * Usage: pipebench [totalkb [chunkbytes]]
+ *
+ * Forks a child that writes TOTALKB kilobytes (default 1024) into a
+ * pipe in writes of CHUNKBYTES bytes (default 4096), while the parent
+ * reads them out in reads of the same size, then reports how long the
+ * transfer took. The data is checked on the way out.
+ *
+ * Before that, it checks that both ends really block: a read of an
+ * empty pipe has to wait for the writer, and a write bigger than the
+ * pipe has to wait for the reader to make room.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#define MAXCHUNK 16384
+#define DELAYMS 200		/* how long checkblocking makes each end wait */
+
+static char buf[MAXCHUNK];
+
+/*
+ * Milliseconds since START.
+ */
+static
+unsigned long
+elapsed(time_t startsecs, unsigned long startnsecs)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (secs - startsecs) * 1000 +
+		((long)nsecs - (long)startnsecs) / 1000000;
+}
+
+static
+void
+delay(void)
+{
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = DELAYMS * 1000000;
+	if (nanosleep(&ts, NULL) < 0) {
+		err(1, "nanosleep");
+	}
+}
+
+/*
+ * The child waits, then writes MAXCHUNK bytes (several times the
+ * pipe's size) at once. The parent's first read must wait for it.
+ * The parent then waits before reading the rest, so the child's
+ * write must wait for room. Half of DELAYMS is allowed for slack.
+ */
+static
+void
+checkblocking(void)
+{
+	time_t secs;
+	unsigned long nsecs, ms, got;
+	int fds[2], status;
+	ssize_t r;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		delay();
+		__time(&secs, &nsecs);
+		r = write(fds[1], buf, MAXCHUNK);
+		if (r != MAXCHUNK) {
+			_exit(1);
+		}
+		if (elapsed(secs, nsecs) < DELAYMS / 2) {
+			/* the write did not wait for room */
+			_exit(2);
+		}
+		close(fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+
+	__time(&secs, &nsecs);
+	r = read(fds[0], buf, 1);
+	ms = elapsed(secs, nsecs);
+	if (r != 1) {
+		err(1, "read");
+	}
+	if (ms < DELAYMS / 2) {
+		errx(1, "read of an empty pipe returned after %lu ms", ms);
+	}
+
+	delay();
+	got = 1;
+	while ((r = read(fds[0], buf, MAXCHUNK)) > 0) {
+		got += r;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 1) {
+		errx(1, "blocking writer failed");
+	}
+	if (WEXITSTATUS(status) == 2) {
+		errx(1, "write to a full pipe did not wait");
+	}
+	if (got != MAXCHUNK) {
+		errx(1, "read %lu bytes, expected %d", got, MAXCHUNK);
+	}
+}
+
+static
+void
+writer(int fd, unsigned long total, size_t chunk)
+{
+	unsigned long done;
+	size_t len, i;
+	ssize_t r;
+
+	for (done = 0; done < total; done += r) {
+		len = total - done < chunk ? total - done : chunk;
+		for (i = 0; i < len; i++) {
+			buf[i] = (char)(done + i);
+		}
+		r = write(fd, buf, len);
+		if (r <= 0) {
+			err(1, "write");
+		}
+	}
+}
+
+static
+unsigned long
+reader(int fd, size_t chunk)
+{
+	unsigned long done;
+	ssize_t r, i;
+
+	done = 0;
+	while ((r = read(fd, buf, chunk)) > 0) {
+		for (i = 0; i < r; i++) {
+			if (buf[i] != (char)(done + i)) {
+				errx(1, "bad data at byte %lu", done + i);
+			}
+		}
+		done += r;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	return done;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long total, got, ms, kbps;
+	size_t chunk;
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	int fds[2], status;
+	pid_t pid;
+
+	total = 1024;
+	chunk = 4096;
+	if (argc > 1) {
+		total = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		chunk = atoi(argv[2]);
+	}
+	if (argc > 3 || total == 0 || chunk == 0 || chunk > MAXCHUNK) {
+		errx(1, "Usage: pipebench [totalkb [chunkbytes]]");
+	}
+	total *= 1024;
+
+	checkblocking();
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	__time(&startsecs, &startnsecs);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1], total, chunk);
+		close(fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	got = reader(fds[0], chunk);
+	close(fds[0]);
+
+	__time(&endsecs, &endnsecs);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		warnx("writer failed");
+	}
+	if (got != total) {
+		errx(1, "read %lu bytes, expected %lu", got, total);
+	}
+
+	if (endnsecs < startnsecs) {
+		endnsecs += 1000000000;
+		endsecs--;
+	}
+	ms = (endsecs - startsecs) * 1000 + (endnsecs - startnsecs) / 1000000;
+	kbps = ms > 0 ? (total / 1024) * 1000 / ms : 0;
+
+	printf("pipebench: %lu KB in %lu-byte chunks: %lu.%03lu seconds, "
+	       "%lu KB/s\n", total / 1024, (unsigned long)chunk,
+	       ms / 1000, ms % 1000, kbps);
+	return 0;
+}
@@ -182,12 +182,13 @@ waitall(pid_t *pids, unsigned numpids)
 }
 
 /*
- * Fetch, compute, and print the timing for one task group.
+ * Fetch, compute, and print the timing for one task group. The total
+ * in nanoseconds goes in *TOTALNSECS if that is not null.
  */
 static
 void
 calcresult(unsigned groupid, time_t startsecs, unsigned long startnsecs,
-	   char *buf, size_t bufmax)
+	   char *buf, size_t bufmax, uint64_t *totalnsecs)
 {
 	time_t secs;
 	unsigned long nsecs;
@@ -202,6 +203,9 @@ calcresult(unsigned groupid, time_t startsecs, unsigned long startnsecs,
 	nsecs -= startnsecs;
 	secs -= startsecs;
 	snprintf(buf, bufmax, "%lld.%09lu", (long long)secs, nsecs);
+	if (totalnsecs != NULL) {
+		*totalnsecs = (uint64_t)secs * 1000000000 + nsecs;
+	}
 }
 
 /*
@@ -227,11 +231,15 @@ runit(unsigned numthinkers, unsigned numgrinders,
 	time_t startsecs;
 	unsigned long startnsecs;
 	char buf[32];
+	uint64_t total;
 	unsigned i;
 
 	printf("Running with %u thinkers, %u grinders, and %u pong groups "
 	       "of size %u each.\n", numthinkers, numgrinders, numponggroups,
 	       ponggroupsize);
+	if (thinknice != 0) {
+		printf("Thinkers run at nice %d.\n", thinknice);
+	}
 
 	usem_init(&startsem, STARTSEM);
 	createresultsfile();
@@ -254,18 +262,26 @@ runit(unsigned numthinkers, unsigned numgrinders,
 
 	printf("--- Timings ---\n");
 	if (numthinkers > 0) {
-		calcresult(0, startsecs, startnsecs, buf, sizeof(buf));
+		calcresult(0, startsecs, startnsecs, buf, sizeof(buf), NULL);
 		printf("Thinkers: %s\n", buf);
 	}
 
 	if (numgrinders > 0) {
-		calcresult(1, startsecs, startnsecs, buf, sizeof(buf));
+		calcresult(1, startsecs, startnsecs, buf, sizeof(buf), NULL);
 		printf("Grinders: %s\n", buf);
 	}
 
+	/*
+	 * The pong tasks spend nearly all their time handing off to
+	 * each other, so the time per wakeup is the wakeup latency
+	 * under whatever load the thinkers and grinders make.
+	 */
 	for (i=0; i<numponggroups; i++) {
-		calcresult(i+2, startsecs, startnsecs, buf, sizeof(buf));
-		printf("Pong group %u: %s\n", i, buf);
+		calcresult(i+2, startsecs, startnsecs, buf, sizeof(buf),
+			   &total);
+		printf("Pong group %u: %s (%llu us per wakeup)\n", i, buf,
+		       (unsigned long long)(total /
+			 pong_wakeups(ponggroupsize) / 1000));
 	}
 
 	closeresultsfile();
@@ -281,6 +297,7 @@ usage(const char *av0)
 	warnx("  [-g grinders]         set number of grinders (default 0)");
 	warnx("  [-p ponggroups]       set number of pong groups (default 1)");
 	warnx("  [-s ponggroupsize]    set pong group size (default 6)");
+	warnx("  [-n nice]             set nice value of thinkers (default 0)");
 	warnx("Thinkers are CPU bound; grinders are memory-bound;");
 	warnx("pong groups are I/O bound.");
 	exit(1);
@@ -309,6 +326,9 @@ main(int argc, char *argv[])
 		else if (!strcmp(argv[i], "-s")) {
 			ponggroupsize = atoi(argv[++i]);
 		}
+		else if (!strcmp(argv[i], "-n")) {
+			thinknice = atoi(argv[++i]);
+		}
 		else {
 			usage(argv[0]);
 		}
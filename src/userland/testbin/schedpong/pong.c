@@ -209,3 +209,14 @@ pong(unsigned groupid, unsigned id)
 	usem_close(&sems[idfwd]);
 	usem_close(&sems[idback]);
 }
+
+/*
+ * Return the number of wakeups (V operations that let a waiting
+ * task go) a pong group of COUNT tasks does: two cyclic rounds and
+ * one reciprocating one.
+ */
+unsigned
+pong_wakeups(unsigned count)
+{
+	return 2 * PONGLOOPS * count + 2 * PONGLOOPS * (count - 1);
+}
@@ -30,9 +30,11 @@
 
 void waitstart(void);
 
+extern int thinknice;
 void think(unsigned groupid, unsigned id);
 void grind(unsigned groupid, unsigned id);
 
 void pong_prep(unsigned groupid, unsigned count);
 void pong_cleanup(unsigned groupid, unsigned count);
 void pong(unsigned groupid, unsigned id);
+unsigned pong_wakeups(unsigned count);
@@ -28,8 +28,14 @@
  * SUCH DAMAGE.
  */
 
+#include <unistd.h>
+#include <err.h>
+
 #include "tasks.h"
 
+/* Nice value for the thinkers, set from the command line. */
+int thinknice;
+
 /*
  * think - cpu-bound task
  *
@@ -44,6 +50,10 @@ think(unsigned groupid, unsigned id)
 	(void)groupid;
 	(void)id;
 
+	if (thinknice != 0 && setpriority(PRIO_PROCESS, 0, thinknice) < 0) {
+		warn("setpriority");
+	}
+
 	waitstart();
 
 	k = 15;
@@ -0,0 +1,100 @@
+/*
+ * waittest - check that waitpid blocks until the child exits.
+ *
+ * Usage: waittest
+ *
+ * Forks NKIDS children that each sleep for a while (the later ones
+ * longer) and exit with their own status. The parent first checks
+ * that WNOHANG finds the first child still running, then waits for
+ * each child in turn, so that every waitpid has to block. Each wait
+ * must return the right pid and status, and not before the child
+ * could have exited.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NKIDS		4
+#define SLEEPMS		500	/* child N sleeps (N+1) * SLEEPMS */
+
+static
+void
+kid(int n)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ((n + 1) * SLEEPMS) / 1000;
+	ts.tv_nsec = (((n + 1) * SLEEPMS) % 1000) * 1000000;
+	if (nanosleep(&ts, NULL) < 0) {
+		err(1, "child %d: nanosleep", n);
+	}
+	_exit(n + 10);
+}
+
+/*
+ * Milliseconds since START.
+ */
+static
+unsigned long
+elapsed(time_t startsecs, unsigned long startnsecs)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (secs - startsecs) * 1000 +
+		((long)nsecs - (long)startnsecs) / 1000000;
+}
+
+int
+main(void)
+{
+	pid_t pids[NKIDS], pid;
+	time_t startsecs;
+	unsigned long startnsecs, ms;
+	int i, status;
+
+	__time(&startsecs, &startnsecs);
+	for (i=0; i<NKIDS; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			kid(i);
+		}
+	}
+
+	pid = waitpid(pids[0], &status, WNOHANG);
+	if (pid < 0) {
+		err(1, "waitpid WNOHANG");
+	}
+	if (pid != 0) {
+		errx(1, "waitpid WNOHANG: child %d exited too soon", pid);
+	}
+
+	for (i=0; i<NKIDS; i++) {
+		pid = waitpid(pids[i], &status, 0);
+		ms = elapsed(startsecs, startnsecs);
+		if (pid < 0) {
+			err(1, "waitpid %d", pids[i]);
+		}
+		if (pid != pids[i]) {
+			errx(1, "waitpid %d returned %d", pids[i], pid);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != i + 10) {
+			errx(1, "child %d: bad status 0x%x", i, status);
+		}
+		if (ms < (unsigned long)(i + 1) * SLEEPMS) {
+			errx(1, "child %d reaped after %lu ms, before it "
+			     "was done sleeping", i, ms);
+		}
+		printf("child %d reaped after %lu ms\n", i, ms);
+	}
+
+	printf("waittest done.\n");
+	return 0;
+}